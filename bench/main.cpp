@@ -0,0 +1,298 @@
+/**
+* @file main.cpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "benchmark/benchmark.h"
+
+#include "scopion/scopion.hpp"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+using namespace scopion;
+
+// Every generator makes a program whose size grows linearly with n, so that anything
+// worse than linear in the reported complexity is a scaling regression
+
+std::string program(std::string const& body)
+{
+  return "(argc, argv){\n" + body + "|> 0;\n}\n";
+}
+
+// n functions, each specialized once
+std::string functions(int64_t n)
+{
+  std::string body;
+  for (int64_t i = 0; i < n; i++) {
+    auto const id = std::to_string(i);
+    body += "f" + id + " = (a){ |> a + " + id + "; };\n";
+    body += "v" + id + " = f" + id + "(argc);\n";
+  }
+  return program(body);
+}
+
+// An expression nested n levels deep
+std::string nesting(int64_t n)
+{
+  std::string expr = "argc";
+  for (int64_t i = 0; i < n; i++)
+    expr = "(" + expr + " + 1)";
+  return program("v = " + expr + ";\n");
+}
+
+// An expression nested n levels deep around a postfix operator, which the parser once
+// backtracked over at every level; it is only parsed, as argc cannot be incremented
+std::string postfixNesting(int64_t n)
+{
+  std::string expr = "argc++";
+  for (int64_t i = 0; i < n; i++)
+    expr = "(1 + " + expr + ")";
+  return program("v = " + expr + ";\n");
+}
+
+// A structure of n fields
+std::string fields(int64_t n)
+{
+  std::string body = "s = [";
+  for (int64_t i = 0; i < n; i++)
+    body += "f" + std::to_string(i) + ": " + std::to_string(i) + ", ";
+  body += "];\nv = s.f" + std::to_string(n - 1) + ";\n";
+  return program(body);
+}
+
+// n structures of a layout of their own; the types of the ten fields spell out the index in
+// binary, so that every literal needs a new struct type
+std::string layouts(int64_t n)
+{
+  std::string body;
+  for (int64_t i = 0; i < n; i++) {
+    body += "s" + std::to_string(i) + " = [";
+    for (int bit = 0; bit < 10; bit++)
+      body += "f" + std::to_string(bit) + ": " + ((i >> bit) & 1 ? "\"x\"" : "0") + ", ";
+    body += "];\n";
+  }
+  return program(body);
+}
+
+// n calls to one lazy function with the same argument types
+std::string callSites(int64_t n)
+{
+  std::string body = "f = (a){ |> a * 2; };\nacc#mut = 0;\n";
+  for (int64_t i = 0; i < n; i++)
+    body += "acc = acc + f(argc);\n";
+  return program(body);
+}
+
+// n functions with a signature, which are compiled where they are written, and a call to one
+std::string signatures(int64_t n)
+{
+  std::string body;
+  for (int64_t i = 0; i < n; i++) {
+    auto const id = std::to_string(i);
+    body += "f" + id + " = (a#type:i32){ |> a + " + id + "; };\n";
+  }
+  return program(body + "v = f0(argc);\n");
+}
+
+// n imported modules, written to a temporary directory
+std::string imports(int64_t n)
+{
+  auto const dir = boost::filesystem::temp_directory_path() / "scopion-bench";
+  boost::filesystem::create_directories(dir);
+
+  std::string body;
+  for (int64_t i = 0; i < n; i++) {
+    auto const id   = std::to_string(i);
+    auto const path = dir / ("mod" + id + ".scc");
+    std::ofstream(path.string()) << "[value: " << id << "]\n";
+    body += "m" + id + " = @import#m:" + path.string() + ";\n";
+    body += "v" + id + " = m" + id + ".value;\n";
+  }
+  return program(body);
+}
+
+ast::expr parseOrSkip(benchmark::State& state, std::string const& code)
+{
+  error err;
+  auto tree = parser::parse(code, err);
+  if (!tree) {
+    state.SkipWithError(err.getMessage().c_str());
+    return ast::expr{};
+  }
+  return *tree;
+}
+
+std::unique_ptr<assembly::module> translateOrSkip(benchmark::State& state, ast::expr const& tree)
+{
+  error err;
+  assembly::translator tr{};
+  tr.createMain();
+  auto* v = tr.translateAST(tree, err);
+  if (!v || !tr.createMainRet(v, err)) {
+    state.SkipWithError(err.getMessage().c_str());
+    return nullptr;
+  }
+  return tr.takeModule();
+}
+
+void parse(benchmark::State& state, std::string (*generate)(int64_t))
+{
+  auto const code = generate(state.range(0));
+  while (state.KeepRunning()) {
+    error err;
+    benchmark::DoNotOptimize(parser::parse(code, err));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(code.size()));
+  state.SetComplexityN(state.range(0));
+}
+
+void translate(benchmark::State& state, std::string (*generate)(int64_t))
+{
+  auto const tree = parseOrSkip(state, generate(state.range(0)));
+  while (state.KeepRunning()) {
+    if (!translateOrSkip(state, tree))
+      break;
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void optimize(benchmark::State& state, std::string (*generate)(int64_t))
+{
+  auto const tree = parseOrSkip(state, generate(state.range(0)));
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    auto mod = translateOrSkip(state, tree);
+    state.ResumeTiming();
+    if (!mod)
+      break;
+    mod->optimize();
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+// The programs in examples/, translated anew, as optimizing changes them
+std::vector<std::unique_ptr<assembly::module>> translateExamples(benchmark::State& state)
+{
+  std::vector<std::unique_ptr<assembly::module>> mods;
+  for (auto const& entry : boost::filesystem::directory_iterator(SCOPION_EXAMPLES_DIR)) {
+    if (entry.path().extension() != ".scc")
+      continue;
+
+    std::ifstream ifs(entry.path().string());
+    std::string code((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    error err;
+    auto tree = parser::parse(code, err, entry.path());
+    if (!tree) {
+      state.SkipWithError(err.getMessage().c_str());
+      return {};
+    }
+    auto mod = translateOrSkip(state, *tree);
+    if (!mod)
+      return {};
+    mods.push_back(std::move(mod));
+  }
+  return mods;
+}
+
+// All of the examples at one level of -O, given by its index in levels
+void optimizeExamples(benchmark::State& state)
+{
+  static std::pair<char const*, std::pair<uint8_t, uint8_t>> const levels[] = {
+      {"O0", {0, 0}}, {"O1", {1, 0}}, {"O2", {2, 0}},
+      {"O3", {3, 0}}, {"Os", {2, 1}}, {"Oz", {2, 2}}};
+  auto const& level = levels[state.range(0)];
+  state.SetLabel(level.first);
+
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    auto mods = translateExamples(state);
+    state.ResumeTiming();
+    if (mods.empty())
+      break;
+    for (auto& mod : mods)
+      mod->optimize(level.second.first, level.second.second);
+  }
+}
+
+// Time to start and finish a program; a lazy run compiles only the functions that are called
+void run(benchmark::State& state, bool lazily)
+{
+  auto const tree = parseOrSkip(state, signatures(state.range(0)));
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    auto mod = translateOrSkip(state, tree);
+    state.ResumeTiming();
+    if (!mod)
+      break;
+
+    error err;
+    int status;
+    if (!(lazily ? mod->runLazily({"bench"}, 0, 0, status, err)
+                 : mod->run({"bench"}, status, err))) {
+      state.SkipWithError(err.getMessage().c_str());
+      break;
+    }
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+#define SCOPION_BENCHMARK(phase, generator, max)                                             \
+  BENCHMARK_CAPTURE(phase, generator, &generator)->RangeMultiplier(4)->Range(1, max)->Complexity()
+
+SCOPION_BENCHMARK(parse, functions, 1024);
+SCOPION_BENCHMARK(parse, nesting, 256);
+SCOPION_BENCHMARK(parse, postfixNesting, 256);
+SCOPION_BENCHMARK(parse, fields, 1024);
+SCOPION_BENCHMARK(parse, layouts, 1024);
+SCOPION_BENCHMARK(parse, callSites, 1024);
+SCOPION_BENCHMARK(parse, imports, 256);
+
+SCOPION_BENCHMARK(translate, functions, 1024);
+SCOPION_BENCHMARK(translate, nesting, 256);
+SCOPION_BENCHMARK(translate, fields, 1024);
+SCOPION_BENCHMARK(translate, layouts, 1024);
+SCOPION_BENCHMARK(translate, callSites, 1024);
+SCOPION_BENCHMARK(translate, imports, 256);
+
+SCOPION_BENCHMARK(optimize, functions, 1024);
+SCOPION_BENCHMARK(optimize, nesting, 256);
+SCOPION_BENCHMARK(optimize, fields, 1024);
+SCOPION_BENCHMARK(optimize, layouts, 1024);
+SCOPION_BENCHMARK(optimize, callSites, 1024);
+SCOPION_BENCHMARK(optimize, imports, 256);
+
+BENCHMARK(optimizeExamples)->DenseRange(0, 5);
+
+BENCHMARK_CAPTURE(run, eager, false)->RangeMultiplier(4)->Range(1, 1024)->Complexity();
+BENCHMARK_CAPTURE(run, lazy, true)->RangeMultiplier(4)->Range(1, 1024)->Complexity();
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,42 @@
+# benchmark.cmake - configure about Google Benchmark
+#
+# (c) copyright 2017 coord.e
+#
+# This file is part of scopion.
+#
+# scopion is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# scopion is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+
+cmake_minimum_required(VERSION 2.8)
+
+# Google Benchmark settings
+include(ExternalProject)
+
+ExternalProject_Add(
+    GoogleBenchmark
+    URL https://github.com/google/benchmark/archive/v1.3.0.zip
+    PREFIX ${CMAKE_CURRENT_BINARY_DIR}/extlib
+    CMAKE_ARGS -DCMAKE_BUILD_TYPE=Release -DBENCHMARK_ENABLE_TESTING=OFF
+    INSTALL_COMMAND ""
+    LOG_DOWNLOAD ON
+    )
+
+ExternalProject_Get_Property(GoogleBenchmark source_dir)
+include_directories(SYSTEM ${source_dir}/include)
+
+ExternalProject_Get_Property(GoogleBenchmark binary_dir)
+add_library(benchmark STATIC IMPORTED)
+set_property(
+    TARGET benchmark
+    PROPERTY IMPORTED_LOCATION ${binary_dir}/src/libbenchmark.a
+    )
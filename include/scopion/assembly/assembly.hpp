@@ -23,7 +23,10 @@
 #define SCOPION_ASSEMBLY_H_
 
 #include "scopion/assembly/evaluator.hpp"
+#include "scopion/assembly/import_cache.hpp"
 #include "scopion/assembly/module.hpp"
+#include "scopion/assembly/object_cache.hpp"
+#include "scopion/assembly/session.hpp"
 #include "scopion/assembly/translator.hpp"
 #include "scopion/assembly/value.hpp"
 
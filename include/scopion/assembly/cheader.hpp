@@ -0,0 +1,47 @@
+
+/**
+* @file cheader.hpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCOPION_ASSEMBLY_CHEADER_H_
+#define SCOPION_ASSEMBLY_CHEADER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace scopion
+{
+namespace assembly
+{
+// Where the declarations of header are cached, under SCOPION_CACHE_DIR
+std::string getCHeaderCachePath(std::string const& header,
+                                std::vector<std::string> const& include_dirs);
+
+// The functions declared by the C header, as LLVM bitcode. They are compiled in-process with
+// clang and cached, to be reused as long as neither the header nor any file it includes
+// changes. Returns nullptr and prints clang's diagnostics if the header cannot be compiled.
+std::shared_ptr<std::string const> compileCHeader(std::string const& header,
+                                                  std::vector<std::string> const& include_dirs);
+
+}  // namespace assembly
+}  // namespace scopion
+
+#endif
@@ -61,8 +61,11 @@ struct evaluator : boost::static_visitor<value*> {
     // throw evaluate_no_support{};
     std::cerr << "T: " << typeid(T).name() << std::endl;
     assert(false && "Evaluating not supported type");
-    return new value();  // void
+    return makeVoid();
   }
+
+private:
+  value* makeVoid();
 };
 
 value* evaluate(value* v, std::vector<value*> const& args, translator& tr);
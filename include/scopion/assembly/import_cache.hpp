@@ -0,0 +1,59 @@
+
+/**
+* @file import_cache.hpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCOPION_ASSEMBLY_IMPORT_CACHE_H_
+#define SCOPION_ASSEMBLY_IMPORT_CACHE_H_
+
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace scopion
+{
+namespace assembly
+{
+// Contents of imported files, read once and then shared by every translator
+// given the cache, including ones running on other threads
+class import_cache
+{
+  using contents_t = std::shared_ptr<std::string const>;
+
+  std::mutex mutex_;
+  std::map<std::string, std::shared_future<contents_t>> entries_;
+
+  contents_t get(std::string const& key, std::function<contents_t()> const& produce);
+
+public:
+  // The file at path, or nullptr if it cannot be read
+  contents_t getFile(std::string const& path);
+  // Bitcode of the declarations in the C header, as compileCHeader returns
+  contents_t getCHeaderIR(std::string const& header, std::vector<std::string> const& include_dirs);
+};
+
+}  // namespace assembly
+}  // namespace scopion
+
+#endif
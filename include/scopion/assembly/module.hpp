@@ -22,15 +22,21 @@
 #ifndef SCOPION_ASSEMBLY_MODULE_H_
 #define SCOPION_ASSEMBLY_MODULE_H_
 
+#include "scopion/assembly/object_cache.hpp"
 #include "scopion/assembly/value.hpp"
 
 #include "scopion/parser/parser.hpp"
 
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Module.h>
 
+#include <boost/functional/hash.hpp>
+
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace scopion
@@ -44,10 +50,22 @@ class module
   llvm::LLVMContext* context_;
   llvm::Module* llvm_module_;
   std::vector<std::string> link_libraries_;
+  std::vector<std::string> dependencies_;  // files imported into this module
   std::string entry_function_name_;
+  // identified struct types created by translators, keyed on their field types
+  std::unordered_map<std::vector<llvm::Type*>,
+                     llvm::StructType*,
+                     boost::hash<std::vector<llvm::Type*>>>
+      struct_types_;
+
+  bool prepareJIT(error& err);
 
 public:
   module(std::string const& name = "", std::string const& entry_function_name = "main");
+  // A module in an existing context, so that it can share types with other modules
+  module(std::string const& name,
+         llvm::LLVMContext& context,
+         std::string const& entry_function_name = "main");
   ~module();
 
   module(const module&) = delete;
@@ -56,14 +74,50 @@ public:
   void printIR(std::ostream& os) const;
   std::string getPrintedIR() const;
   std::string getEntryFunctionName() const;
+  // Optimizes the module as -O<optLevel> does, or as -Os/-Oz does when sizeLevel is 1/2
   void optimize(uint8_t optLevel = 3, uint8_t sizeLevel = 0);
 
   bool verify(error& err) const;
+  // Gives the functions with no name internal linkage. The code generator names them
+  // __unnamed_<n>, which would clash between objects compiled separately and linked together.
+  void hideUnnamedFunctions();
+  // Generates native code for the target triple in-process and writes it to path
+  bool emit(std::string const& path, std::string const& triple, bool assembly, error& err);
+  // Optimizes the module as optimize does and emits it as objects, splitting it after inlining
+  // and handling the partitions on jobs threads. objects is set to the paths of the objects,
+  // which are the same whatever jobs is.
+  bool emitSplit(std::string const& path,
+                 std::string const& triple,
+                 uint8_t optLevel,
+                 uint8_t sizeLevel,
+                 unsigned jobs,
+                 std::vector<std::string>& objects,
+                 error& err);
+  // JIT-compiles the module and calls the entry function with args as argv
+  bool run(std::vector<std::string> const& args,
+           int& status,
+           error& err,
+           object_cache* cache = nullptr);
+  // Calls the entry function of an object loaded from cache, in place of this module's code
+  bool runCached(object_cache& cache, std::vector<std::string> const& args, int& status, error& err);
+  // Like run, but compiles and optimizes each function only when it is first called
+  bool runLazily(std::vector<std::string> const& args,
+                 uint8_t optLevel,
+                 uint8_t sizeLevel,
+                 int& status,
+                 error& err);
   llvm::LLVMContext& getContext() const;
   llvm::Module* getLLVMModule() const;
+  std::unique_ptr<llvm::Module> releaseLLVMModule();
   std::string generateLinkerFlags();
+  std::vector<std::string> const& getLinkLibraries() const { return link_libraries_; }
+  std::vector<std::string> const& getDependencies() const { return dependencies_; }
 };
 
+// Loads the library linked with -l<name> into this process, for the JIT to resolve symbols from.
+// Returns false and sets message if it cannot be loaded.
+bool loadLinkLibrary(std::string const& name, std::string& message);
+
 }  // namespace assembly
 }  // namespace scopion
 
@@ -0,0 +1,74 @@
+
+/**
+* @file object_cache.hpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCOPION_ASSEMBLY_OBJECT_CACHE_H_
+#define SCOPION_ASSEMBLY_OBJECT_CACHE_H_
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <boost/filesystem/path.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace scopion
+{
+namespace assembly
+{
+class module;
+
+// Keeps JIT-compiled objects under SCOPION_CACHE_DIR. An entry is identified by
+// a key the caller derives from everything known before translation (source,
+// flags, optimization level, target); the files imported during translation
+// are recorded with the entry and checked when it is loaded.
+class object_cache : public llvm::ObjectCache
+{
+  boost::filesystem::path dir_;
+  std::unique_ptr<llvm::MemoryBuffer> object_;
+  std::vector<std::string> dependencies_;
+  std::vector<std::string> link_libraries_;
+
+public:
+  explicit object_cache(std::string const& key);
+
+  static std::string hash(std::vector<std::string> const& parts);
+  // SCOPION_CACHE_DIR in the home directory, or in the temporary directory if $HOME is not set
+  static boost::filesystem::path directory();
+
+  // Reads the entry; false if there is none or an imported file has changed since
+  bool load();
+  // Remembers what the module depends on, to be stored with its object
+  void record(module const& mod);
+
+  std::unique_ptr<llvm::MemoryBuffer> takeObject() { return std::move(object_); }
+  std::vector<std::string> const& getLinkLibraries() const { return link_libraries_; }
+
+  void notifyObjectCompiled(llvm::Module const* m, llvm::MemoryBufferRef obj) override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(llvm::Module const* m) override;
+};
+
+}  // namespace assembly
+}  // namespace scopion
+
+#endif
@@ -0,0 +1,73 @@
+
+/**
+* @file session.hpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCOPION_ASSEMBLY_SESSION_H_
+#define SCOPION_ASSEMBLY_SESSION_H_
+
+#include "scopion/assembly/translator.hpp"
+
+#include "scopion/error.hpp"
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace scopion
+{
+namespace assembly
+{
+// Evaluates a program piece by piece, as a REPL does. Each piece is translated
+// into a module of its own against the symbols the previous pieces left, and
+// added to a JIT that lives as long as the session.
+class session
+{
+  llvm::LLVMContext context_;
+  std::unique_ptr<translator> translator_;
+  std::unique_ptr<llvm::ExecutionEngine> engine_;
+  module* current_;  // owned by translator_
+  value* root_;
+  std::set<std::string> loaded_libraries_;
+  uint32_t count_ = 0;
+
+  std::string moduleName() const { return "__repl_" + std::to_string(count_); }
+  void loadLibrary(std::string const& lib);
+
+public:
+  explicit session(std::vector<std::string> const& flags = std::vector<std::string>{});
+  ~session();
+
+  session(session const&) = delete;
+  session& operator=(session const&) = delete;
+
+  // Runs code; result is set to its value when that is a number or a boolean
+  bool eval(std::string const& code, std::string& result, error& err);
+};
+
+}  // namespace assembly
+}  // namespace scopion
+
+#endif
@@ -0,0 +1,77 @@
+/**
+* @file shared_map.hpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCOPION_ASSEMBLY_SHARED_MAP_H_
+#define SCOPION_ASSEMBLY_SHARED_MAP_H_
+
+#include <cstddef>
+#include <map>
+#include <memory>
+
+namespace scopion
+{
+namespace assembly
+{
+// std::map with O(1) copies. Copies share one underlying map, which is cloned
+// by whichever side writes to it first.
+template <typename Key, typename T>
+class shared_map
+{
+  using map_type = std::map<Key, T>;
+
+  std::shared_ptr<map_type> map_;
+
+  map_type const& get() const
+  {
+    static map_type const empty;
+    return map_ ? *map_ : empty;
+  }
+
+  map_type& mut()
+  {
+    if (!map_)
+      map_ = std::make_shared<map_type>();
+    else if (map_.use_count() > 1)
+      map_ = std::make_shared<map_type>(*map_);
+    return *map_;
+  }
+
+public:
+  using value_type     = typename map_type::value_type;
+  using const_iterator = typename map_type::const_iterator;
+
+  const_iterator begin() const { return get().begin(); }
+  const_iterator end() const { return get().end(); }
+  const_iterator find(Key const& key) const { return get().find(key); }
+
+  bool empty() const { return get().empty(); }
+  size_t size() const { return get().size(); }
+  size_t count(Key const& key) const { return get().count(key); }
+  T const& at(Key const& key) const { return get().at(key); }
+
+  T& operator[](Key const& key) { return mut()[key]; }
+  size_t erase(Key const& key) { return count(key) ? mut().erase(key) : 0; }
+};
+
+}  // namespace assembly
+}  // namespace scopion
+
+#endif
@@ -23,6 +23,7 @@
 #define SCOPION_ASSEMBLY_TRANSLATOR_H_
 
 #include "scopion/assembly/evaluator.hpp"
+#include "scopion/assembly/import_cache.hpp"
 #include "scopion/assembly/module.hpp"
 #include "scopion/assembly/value.hpp"
 #include "scopion/ast/ast.hpp"
@@ -33,12 +34,22 @@
 #include <llvm/IR/Module.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <boost/filesystem/path.hpp>
+#include <boost/optional.hpp>
+
+#include <map>
+#include <memory>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 namespace scopion
 {
 namespace assembly
 {
+// Extension of the interface file written next to the object of a module
+constexpr char const* interface_extension = ".sci";
+
 template <typename T>
 std::string getNameString(T* v)
 {
@@ -52,27 +63,43 @@ class translator : public boost::static_visitor<value*>
 {
   std::unique_ptr<module> module_;
   llvm::IRBuilder<> builder_;
-  std::map<std::string, std::unique_ptr<llvm::Module>> loaded_map_;
+  std::map<std::string, value*> loaded_map_;  // namespaces of the imported IR, by path
+  std::shared_ptr<import_cache> imports_;
+  std::shared_ptr<region> region_;
   value* thisScope_;
+  value* const rootScope_;
   std::vector<std::string> flags_;
 
+  // the placeholder function of the literal (see region::makeLazyFunction), the argument types
+  // and the shape of the arguments
+  using specialization_key_t = std::tuple<llvm::Value*,
+                                          std::vector<llvm::Type*>,
+                                          std::vector<std::pair<std::string, llvm::Value*>>>;
+  std::map<specialization_key_t, value*> specializations_;
+
+  // node forced to be translated as an lvalue, without rewriting its attribute
+  ast::attribute const* lval_target_ = nullptr;
+
   friend struct evaluator;
 
 public:
   translator();
   translator(boost::filesystem::path const&,
              std::vector<std::string> const& = std::vector<std::string>{},
-             std::string const& efname       = "main");
+             std::string const& efname       = "main",
+             std::shared_ptr<import_cache>   = nullptr);
   translator(std::unique_ptr<module>&& module,
              llvm::IRBuilder<>& builder,
-             std::vector<std::string> const& = std::vector<std::string>{});
+             std::shared_ptr<region> rg,
+             std::vector<std::string> const& = std::vector<std::string>{},
+             std::shared_ptr<import_cache>   = nullptr);
 
-  value* operator()(ast::value);
-  value* operator()(ast::operators);
+  value* operator()(ast::value const&);
+  value* operator()(ast::operators const&);
 
-  value* operator()(ast::integer);
-  value* operator()(ast::decimal);
-  value* operator()(ast::boolean);
+  value* operator()(ast::integer const&);
+  value* operator()(ast::decimal const&);
+  value* operator()(ast::boolean const&);
   value* operator()(ast::string const&);
   value* operator()(ast::pre_variable const&);
   value* operator()(ast::variable const&);
@@ -95,7 +122,7 @@ public:
     std::vector<llvm::Value*> args_llvm;
     for (; it != ast::val(op).end(); it++) {
       if (ast::isa<ast::arglist>(*it) && target->getType()->isStruct()) {  // unpack arglist
-        std::vector<ast::expr> al = ast::val(ast::unpack<ast::arglist>(*it));
+        auto const& al = ast::val(ast::unpack<ast::arglist>(*it));
         for (auto const& x : al) {
           auto thev = boost::apply_visitor(*this, x);
 
@@ -123,8 +150,8 @@ public:
                     ast::attr(op).where, errorType::Translate);
       auto v         = evaluate(f->second, args, *this);
       auto ret_table = v->getRetTable();
-      auto destv =
-          new value(builder_.CreateCall(v->getLLVM(), llvm::ArrayRef<llvm::Value*>(args_llvm)), op);
+      auto destv     = region_->makeValue(
+          builder_.CreateCall(v->getLLVM(), llvm::ArrayRef<llvm::Value*>(args_llvm)), op);
       if (ret_table)
         destv->applyRetTable(ret_table);
       return destv;
@@ -145,11 +172,25 @@ public:
 
   bool hasFlag(std::string const& key);
 
+  // Hands off the current module and continues translating into next. Top-level symbols defined
+  // by earlier modules are redeclared in next; function-local ones are dropped.
+  std::unique_ptr<module> swapModule(std::unique_ptr<module>&& next);
+
   llvm::IRBuilder<>& getBuilder() { return builder_; }
   llvm::IRBuilder<> const& getBuilder() const { return builder_; }
-  std::unique_ptr<module>&& takeModule() { return std::move(module_); }
+  // Hands off the module and releases every value produced by this translator
+  std::unique_ptr<module> takeModule()
+  {
+    specializations_.clear();
+    thisScope_ = nullptr;
+    region_.reset();
+    return std::move(module_);
+  }
 
   value* import(std::string const& path, ast::pre_variable const& astv);
+  // Compiles the functions with a signature in the structure tree, and writes to interface
+  // what importers need to use the rest: see readInterface()
+  bool exportModule(ast::expr const& tree, std::string& interface, error& err);
   value* importIR(std::string const& path, ast::pre_variable const& astv);
   value* importCHeader(std::string const& path, ast::pre_variable const& astv);
 
@@ -165,6 +206,28 @@ public:
   void insertGCInitInMain();
 
 private:
+  template <typename T>
+  bool isLval(T const& astv) const
+  {
+    return ast::attr(astv).lval || &ast::attr(astv) == lval_target_;
+  }
+  value* translateAsLval(ast::expr const&);
+  llvm::StructType* getStructType(std::vector<llvm::Type*> const& fields, std::string const& name);
+  value* importIR(std::string const& path,
+                  std::shared_ptr<std::string const> const& ir,
+                  ast::pre_variable const& astv);
+  // Reads an interface file written by exportModule(): the module's value as source, and the
+  // functions compiled into its object, which the source refers to
+  boost::optional<ast::expr> readInterface(std::string const& code,
+                                           boost::filesystem::path const& path,
+                                           declaration_table const*& definitions,
+                                           error& err);
+  llvm::Function* declareFunction(std::string const& name, llvm::FunctionType* type);
+  // Specializes the function literal v for the parameter types written in it
+  value* compileWithSignature(value* v);
+  // Compiles v if it is a function with a signature whose compilation was deferred
+  value* instantiate(value* v);
+
   bool copyFull(value* src,
                 value* dest,
                 std::string const& name,
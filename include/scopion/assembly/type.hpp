@@ -53,14 +53,9 @@ public:
   type(type const&) = delete;
   type& operator=(type const&) = delete;
 
-  type* copyWithNewLLVMType(llvm::Type* ty) const { return new type{ty, is_lazy_, is_const_}; }
-  type* copy() const { return copyWithNewLLVMType(llvm_type_); }
-
   bool isLazy() const { return is_lazy_; }
   bool isConst() const { return is_const_; }
-  void isConst(bool c) { is_const_ = c; }
   llvm::Type* getLLVM() const { return llvm_type_; }
-  void setLLVM(llvm::Type* ty) { llvm_type_ = ty; }
 
   bool isFundamental() const
   {
@@ -22,6 +22,7 @@
 #ifndef SCOPION_ASSEMBLY_VALUE_H_
 #define SCOPION_ASSEMBLY_VALUE_H_
 
+#include "scopion/assembly/shared_map.hpp"
 #include "scopion/assembly/type.hpp"
 #include "scopion/ast/expr.hpp"
 #include "scopion/ast/util.hpp"
@@ -30,11 +31,17 @@
 #include <boost/variant.hpp>
 
 #include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
 
 #include <cassert>
+#include <deque>
 #include <map>
+#include <memory>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 namespace scopion
@@ -42,47 +49,40 @@ namespace scopion
 namespace assembly
 {
 class value;
+class region;
 
-using ret_table_t = std::pair<std::map<std::string, value*>, std::map<std::string, uint32_t>>;
+using symbol_table = shared_map<std::string, value*>;
+using field_table  = shared_map<std::string, uint32_t>;
+using ret_table_t  = std::pair<symbol_table, field_table>;
+// Functions declared by an imported module, which are declared in the module being translated
+// only when they are referred to
+using declaration_table = std::map<std::string, llvm::FunctionType*>;
 
 class value
 {
+  region* region_;
   llvm::Value* llvm_value_ = nullptr;
   value* parent_           = nullptr;
   ast::expr ast_value_;
   type* type_;
-  std::map<std::string, value*> symbols_;
-  std::map<std::string, uint32_t> fields_;
+  symbol_table symbols_;
+  field_table fields_;
   std::string name_;
-  ret_table_t* ret_table_ = nullptr;
+  ret_table_t* ret_table_              = nullptr;
+  declaration_table const* declarations_ = nullptr;
 
 public:
-  value(llvm::Value* llvm_value, ast::expr ast_value, bool is_lazy = false, bool is_const = false)
-      : llvm_value_(llvm_value),
-        ast_value_(ast_value),
-        type_(new type{llvm_value_ ? llvm_value_->getType() : nullptr, is_lazy, is_const})
-  {
-  }
-  value() : type_(new type{}) {}
+  value(region& rg,
+        llvm::Value* llvm_value,
+        ast::expr ast_value,
+        bool is_lazy  = false,
+        bool is_const = false);
+  explicit value(region& rg);
 
   value(value const&) = delete;
   value& operator=(value const&) = delete;
 
-  value* copyWithNewLLVMValue(llvm::Value* v) const
-  {
-    auto newval         = new value();
-    newval->llvm_value_ = v;
-    newval->parent_     = parent_;
-    newval->ast_value_  = ast_value_;
-    for (auto const& x : symbols_) {
-      newval->symbols_[x.first] = x.second->copy();
-    }
-    newval->fields_    = fields_;
-    newval->ret_table_ = ret_table_;
-    newval->name_      = name_;
-    newval->type_      = type_->copyWithNewLLVMType(v->getType());
-    return newval;
-  }
+  value* copyWithNewLLVMValue(llvm::Value* v) const;
 
   value* copy() { return copyWithNewLLVMValue(llvm_value_); }
 
@@ -93,11 +93,9 @@ public:
     if (llvm_value_)
       assert(llvm_value_->getType() == type_->getLLVM() &&
              "Type mismatch between llvm::Type* and assembly::type*");
-
-    if (llvm_value_)
-      type_->setLLVM(llvm_value_->getType());
     return type_;
   }
+  void setConst(bool c);
 
   value* getParent() const { return parent_; }
   void setParent(value* parent) { parent_ = parent; }
@@ -108,33 +106,148 @@ public:
     symbols_ = table->first;
     fields_  = table->second;
   }
-  ret_table_t* generateRetTable()
-  {
-    auto ret_table = new ret_table_t();
-    for (auto const& s : symbols_) {
-      ret_table->first[s.first] = s.second->copy();
-    }
-    ret_table->second = fields_;
-    return ret_table;
-  }
+  ret_table_t* generateRetTable();
+  // Non-null if this is the namespace of an import
+  declaration_table const* getDeclarations() const { return declarations_; }
+  void setDeclarations(declaration_table const* table) { declarations_ = table; }
   std::string getName() const { return name_; }
   void setName(std::string const& name) { name_ = name; }
   ast::expr& getAst() { return ast_value_; }
   ast::expr const& getAst() const { return ast_value_; }
   llvm::Value* getLLVM() const { return llvm_value_; }
-  void setLLVM(llvm::Value* const val)
+  void setLLVM(llvm::Value* const val);
+
+  symbol_table& symbols() { return symbols_; }
+  symbol_table const& symbols() const { return symbols_; }
+  field_table& fields() { return fields_; }
+  field_table const& fields() const { return fields_; }
+};
+
+// Owns every value, type, return table and declaration table created while
+// translating a module, and frees them together. Types are interned: values of
+// the same llvm type, laziness and constness share one type object.
+// It also remembers the modules imported during the translation, by canonical path.
+class region
+{
+public:
+  struct imported_module {
+    ast::expr ast;
+    value* val;
+    // for an interface file, the functions compiled into the module's object
+    declaration_table const* definitions;
+  };
+
+private:
+  std::deque<value> values_;
+  std::map<std::tuple<llvm::Type*, bool, bool>, type> types_;
+  std::deque<ret_table_t> ret_tables_;
+  std::deque<declaration_table> declaration_tables_;
+  std::map<std::string, imported_module> imported_modules_;
+  std::deque<std::unique_ptr<llvm::Function>> lazy_functions_;
+
+public:
+  region()              = default;
+  region(region const&) = delete;
+  region& operator=(region const&) = delete;
+
+  template <typename... Args>
+  value* makeValue(Args&&... args)
+  {
+    values_.emplace_back(*this, std::forward<Args>(args)...);
+    return &values_.back();
+  }
+
+  type* getType(llvm::Type* llvm_type, bool is_lazy = false, bool is_const = false)
+  {
+    auto key = std::make_tuple(llvm_type, is_lazy, is_const);
+    auto it  = types_.find(key);
+    if (it == types_.end())
+      it = types_
+               .emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                        std::forward_as_tuple(llvm_type, is_lazy, is_const))
+               .first;
+    return &it->second;
+  }
+
+  ret_table_t* makeRetTable()
+  {
+    ret_tables_.emplace_back();
+    return &ret_tables_.back();
+  }
+
+  declaration_table* makeDeclarationTable()
   {
-    if (val)
-      type_->setLLVM(val->getType());
-    llvm_value_ = val;
+    declaration_tables_.emplace_back();
+    return &declaration_tables_.back();
   }
 
-  std::map<std::string, value*>& symbols() { return symbols_; }
-  std::map<std::string, value*> const& symbols() const { return symbols_; }
-  std::map<std::string, uint32_t>& fields() { return fields_; }
-  std::map<std::string, uint32_t> const& fields() const { return fields_; }
+  // The function a lazy function literal stands for. It is in no module and is never called; it
+  // identifies the literal among specializations (see evaluator) for as long as the region lives
+  llvm::Function* makeLazyFunction(llvm::FunctionType* type, std::string const& name)
+  {
+    lazy_functions_.emplace_back(
+        llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, nullptr));
+    return lazy_functions_.back().get();
+  }
+
+  imported_module* findImportedModule(std::string const& path)
+  {
+    auto const it = imported_modules_.find(path);
+    return it == imported_modules_.end() ? nullptr : &it->second;
+  }
+  void addImportedModule(std::string const& path, imported_module const& m)
+  {
+    imported_modules_.emplace(path, m);
+  }
 };
 
+inline value::value(
+    region& rg, llvm::Value* llvm_value, ast::expr ast_value, bool is_lazy, bool is_const)
+    : region_(&rg),
+      llvm_value_(llvm_value),
+      ast_value_(std::move(ast_value)),
+      type_(rg.getType(llvm_value_ ? llvm_value_->getType() : nullptr, is_lazy, is_const))
+{
+}
+
+inline value::value(region& rg) : region_(&rg), type_(rg.getType(nullptr)) {}
+
+inline value* value::copyWithNewLLVMValue(llvm::Value* v) const
+{
+  auto newval           = region_->makeValue();
+  newval->llvm_value_   = v;
+  newval->parent_       = parent_;
+  newval->ast_value_    = ast_value_;
+  newval->symbols_      = symbols_;
+  newval->fields_       = fields_;
+  newval->ret_table_    = ret_table_;
+  newval->declarations_ = declarations_;
+  newval->name_         = name_;
+  newval->type_         = region_->getType(v ? v->getType() : nullptr, type_->isLazy(),
+                                           type_->isConst());
+  return newval;
+}
+
+inline void value::setConst(bool c)
+{
+  type_ = region_->getType(type_->getLLVM(), type_->isLazy(), c);
+}
+
+inline ret_table_t* value::generateRetTable()
+{
+  auto ret_table    = region_->makeRetTable();
+  ret_table->first  = symbols_;
+  ret_table->second = fields_;
+  return ret_table;
+}
+
+inline void value::setLLVM(llvm::Value* const val)
+{
+  if (val)
+    type_ = region_->getType(val->getType(), type_->isLazy(), type_->isConst());
+  llvm_value_ = val;
+}
+
 }  // namespace assembly
 }  // namespace scopion
 
@@ -0,0 +1,157 @@
+/**
+* @file arena.hpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCOPION_AST_ARENA_H_
+#define SCOPION_AST_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace scopion
+{
+namespace ast
+{
+// Bump allocator owning the nodes of one compilation. Memory is released all
+// at once when the last node allocated from it is gone.
+class arena
+{
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  char* head_ = nullptr;
+  size_t left_ = 0;
+
+public:
+  static constexpr size_t chunk_size = 64 * 1024;
+
+  arena()             = default;
+  arena(arena const&) = delete;
+  arena& operator=(arena const&) = delete;
+
+  void* allocate(size_t size, size_t align);
+
+  // The arena new nodes are allocated from on this thread; may be null.
+  static std::shared_ptr<arena>& current();
+};
+
+class arena_scope
+{
+  std::shared_ptr<arena> prev_;
+
+public:
+  explicit arena_scope(std::shared_ptr<arena> a) : prev_(std::move(arena::current()))
+  {
+    arena::current() = std::move(a);
+  }
+  ~arena_scope() { arena::current() = std::move(prev_); }
+
+  arena_scope(arena_scope const&) = delete;
+  arena_scope& operator=(arena_scope const&) = delete;
+};
+
+template <typename T>
+class arena_allocator
+{
+  template <typename U>
+  friend class arena_allocator;
+
+  std::shared_ptr<arena> arena_;
+
+public:
+  using value_type = T;
+
+  explicit arena_allocator(std::shared_ptr<arena> a) : arena_(std::move(a)) {}
+  template <typename U>
+  arena_allocator(arena_allocator<U> const& other) : arena_(other.arena_)
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    if (arena_)
+      return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t)
+  {
+    if (!arena_)
+      ::operator delete(p);
+  }
+
+  template <typename U>
+  bool operator==(arena_allocator<U> const& rhs) const
+  {
+    return arena_ == rhs.arena_;
+  }
+  template <typename U>
+  bool operator!=(arena_allocator<U> const& rhs) const
+  {
+    return arena_ != rhs.arena_;
+  }
+};
+
+// Shared, copy-on-write handle to a node payload. Copying a node is O(1)
+// regardless of the size of the subtree below it.
+template <typename T, bool = std::is_arithmetic<T>::value>
+class node
+{
+  std::shared_ptr<T> ptr_;
+
+  template <typename... Args>
+  static std::shared_ptr<T> make(Args&&... args)
+  {
+    return std::allocate_shared<T>(arena_allocator<T>(arena::current()),
+                                   std::forward<Args>(args)...);
+  }
+
+public:
+  node() : ptr_(make()) {}
+  node(T const& v) : ptr_(make(v)) {}
+  node(T&& v) : ptr_(make(std::move(v))) {}
+
+  T const& get() const { return *ptr_; }
+  T& get()
+  {
+    if (ptr_.use_count() > 1)
+      ptr_ = make(*ptr_);
+    return *ptr_;
+  }
+};
+
+template <typename T>
+class node<T, true>
+{
+  T value_;
+
+public:
+  node() : value_() {}
+  node(T const& v) : value_(v) {}
+
+  T const& get() const { return value_; }
+  T& get() { return value_; }
+};
+
+}  // namespace ast
+}  // namespace scopion
+
+#endif
@@ -26,6 +26,7 @@
 #include "scopion/ast/expr.hpp"
 #include "scopion/ast/operators.hpp"
 #include "scopion/ast/printer.hpp"
+#include "scopion/ast/source_printer.hpp"
 #include "scopion/ast/util.hpp"
 #include "scopion/ast/value.hpp"
 #include "scopion/ast/value_wrapper.hpp"
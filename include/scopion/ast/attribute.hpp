@@ -38,7 +38,6 @@ struct attribute {
   std::unordered_map<std::string, std::string> attributes;
   bool lval    = false;
   bool to_call = false;
-  bool survey  = false;
 };
 bool operator==(attribute const& lhs, attribute const& rhs);
 
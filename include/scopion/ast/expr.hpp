@@ -30,6 +30,7 @@
 #include <initializer_list>
 #include <iostream>
 #include <type_traits>
+#include <utility>
 
 namespace scopion
 {
@@ -58,6 +59,7 @@ public:
     std::copy(args.begin(), args.end(), exprs_.begin());
   }
   op_base(exprs_t const& args) : exprs_(args) {}
+  op_base(exprs_t&& args) : exprs_(std::move(args)) {}
 
   expr const& operator[](size_t idx) const { return exprs_[idx]; }
   expr& operator[](size_t idx) { return exprs_[idx]; }
@@ -172,37 +172,37 @@ using binary_op = op<Op, 2>;
 template <class Op>
 using ternary_op = op<Op, 3>;
 
-using operators = boost::variant<boost::recursive_wrapper<binary_op<add>>,
-                                 boost::recursive_wrapper<binary_op<sub>>,
-                                 boost::recursive_wrapper<binary_op<pow>>,
-                                 boost::recursive_wrapper<binary_op<mul>>,
-                                 boost::recursive_wrapper<binary_op<div>>,
-                                 boost::recursive_wrapper<binary_op<rem>>,
-                                 boost::recursive_wrapper<binary_op<shl>>,
-                                 boost::recursive_wrapper<binary_op<shr>>,
-                                 boost::recursive_wrapper<binary_op<iand>>,
-                                 boost::recursive_wrapper<binary_op<ior>>,
-                                 boost::recursive_wrapper<binary_op<ixor>>,
-                                 boost::recursive_wrapper<binary_op<land>>,
-                                 boost::recursive_wrapper<binary_op<lor>>,
-                                 boost::recursive_wrapper<binary_op<eeq>>,
-                                 boost::recursive_wrapper<binary_op<neq>>,
-                                 boost::recursive_wrapper<binary_op<gt>>,
-                                 boost::recursive_wrapper<binary_op<lt>>,
-                                 boost::recursive_wrapper<binary_op<gtq>>,
-                                 boost::recursive_wrapper<binary_op<ltq>>,
-                                 boost::recursive_wrapper<binary_op<assign>>,
-                                 boost::recursive_wrapper<single_op<ret>>,
-                                 boost::recursive_wrapper<binary_op<call>>,
-                                 boost::recursive_wrapper<binary_op<at>>,
-                                 boost::recursive_wrapper<binary_op<dot>>,
-                                 boost::recursive_wrapper<binary_op<odot>>,
-                                 boost::recursive_wrapper<binary_op<adot>>,
-                                 boost::recursive_wrapper<single_op<lnot>>,
-                                 boost::recursive_wrapper<single_op<inot>>,
-                                 boost::recursive_wrapper<single_op<inc>>,
-                                 boost::recursive_wrapper<single_op<dec>>,
-                                 boost::recursive_wrapper<ternary_op<cond>>>;
+using operators = boost::variant<binary_op<add>,
+                                 binary_op<sub>,
+                                 binary_op<pow>,
+                                 binary_op<mul>,
+                                 binary_op<div>,
+                                 binary_op<rem>,
+                                 binary_op<shl>,
+                                 binary_op<shr>,
+                                 binary_op<iand>,
+                                 binary_op<ior>,
+                                 binary_op<ixor>,
+                                 binary_op<land>,
+                                 binary_op<lor>,
+                                 binary_op<eeq>,
+                                 binary_op<neq>,
+                                 binary_op<gt>,
+                                 binary_op<lt>,
+                                 binary_op<gtq>,
+                                 binary_op<ltq>,
+                                 binary_op<assign>,
+                                 single_op<ret>,
+                                 binary_op<call>,
+                                 binary_op<at>,
+                                 binary_op<dot>,
+                                 binary_op<odot>,
+                                 binary_op<adot>,
+                                 single_op<lnot>,
+                                 single_op<inot>,
+                                 single_op<inc>,
+                                 single_op<dec>,
+                                 ternary_op<cond>>;
 }  // namespace ast
 }  // namespace scopion
 
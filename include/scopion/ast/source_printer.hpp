@@ -0,0 +1,314 @@
+/**
+* @file source_printer.hpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SCOPION_AST_SOURCE_PRINTER_H_
+#define SCOPION_AST_SOURCE_PRINTER_H_
+
+#include "scopion/ast/util.hpp"
+
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+namespace scopion
+{
+namespace ast
+{
+// Prints a tree back as scopion source that parses to an equal tree. Unlike printer, which is
+// for reading, nested operators are parenthesized and everything is printed on one line.
+class source_printer : boost::static_visitor<void>
+{
+  std::ostream& _s;
+
+  void print(expr const& e) const { boost::apply_visitor(*this, e); }
+
+  void printAttributes(attribute const& a) const
+  {
+    for (auto const& kv : a.attributes) {
+      _s << "#" << kv.first;
+      if (!kv.second.empty())
+        _s << ":" << kv.second;
+      _s << " ";  // attribute values may contain brackets, which must not be read as theirs
+    }
+  }
+
+  template <typename T>
+  void printLines(T const& lines) const
+  {
+    for (auto const& line : lines) {
+      print(line);
+      _s << "; ";
+    }
+  }
+
+  // Operands are parenthesized when they are operators themselves. Values are not, as the
+  // parser reads a parenthesized list of variables as the parameters of a function.
+  void printOperand(expr const& e) const
+  {
+    if (e.type() == typeid(value)) {
+      print(e);
+    } else {
+      _s << "(";
+      print(e);
+      _s << ")";
+    }
+  }
+
+  template <typename T>
+  void printList(T const& list) const
+  {
+    for (auto it = list.begin(); it != list.end(); ++it) {
+      if (it != list.begin())
+        _s << ", ";
+      print(*it);
+    }
+  }
+
+  template <typename Op>
+  void printMember(binary_op<Op> const& o) const
+  {
+    printOp(o, [&] {
+      printOperand(val(o)[0]);
+      _s << Op::str;
+      print(val(o)[1]);
+    });
+  }
+
+  // An operator takes attributes only when parenthesized
+  template <typename T, typename F>
+  void printOp(T const& o, F f) const
+  {
+    if (attr(o).attributes.empty()) {
+      f();
+    } else {
+      _s << "(";
+      f();
+      _s << ")";
+      printAttributes(attr(o));
+    }
+  }
+
+public:
+  explicit source_printer(std::ostream& s) : _s(s) {}
+
+  auto operator()(value const& v) const -> void { boost::apply_visitor(*this, v); }
+  auto operator()(operators const& v) const -> void { boost::apply_visitor(*this, v); }
+
+  auto operator()(integer const& v) const -> void
+  {
+    _s << val(v);
+    printAttributes(attr(v));
+  }
+
+  auto operator()(decimal const& v) const -> void
+  {
+    std::ostringstream ss;
+    ss << std::setprecision(std::numeric_limits<double>::max_digits10) << val(v);
+    auto str = ss.str();
+    if (str.find_first_of(".e") == std::string::npos)
+      str += ".0";
+    else if (str.find('.') == std::string::npos)
+      str.insert(str.find('e'), ".0");
+    _s << str;
+    printAttributes(attr(v));
+  }
+
+  auto operator()(boolean const& v) const -> void
+  {
+    _s << std::boolalpha << val(v);
+    printAttributes(attr(v));
+  }
+
+  auto operator()(string const& v) const -> void
+  {
+    _s << '"';
+    for (auto c : val(v)) {
+      switch (c) {
+        case '"':
+          _s << "\\\"";
+          break;
+        case '\\':
+          _s << "\\\\";
+          break;
+        case '\n':
+          _s << "\\n";
+          break;
+        case '\t':
+          _s << "\\t";
+          break;
+        case '\b':
+          _s << "\\b";
+          break;
+        case '\f':
+          _s << "\\f";
+          break;
+        case '\r':
+          _s << "\\r";
+          break;
+        case '\v':
+          _s << "\\v";
+          break;
+        case '\a':
+          _s << "\\a";
+          break;
+        default:
+          _s << c;
+      }
+    }
+    _s << '"';
+    printAttributes(attr(v));
+  }
+
+  auto operator()(variable const& v) const -> void
+  {
+    _s << val(v);
+    printAttributes(attr(v));
+  }
+
+  auto operator()(pre_variable const& v) const -> void
+  {
+    _s << val(v);
+    printAttributes(attr(v));
+  }
+
+  auto operator()(identifier const& v) const -> void
+  {
+    _s << val(v);
+    printAttributes(attr(v));
+  }
+
+  auto operator()(struct_key const& v) const -> void { _s << val(v); }
+
+  auto operator()(attribute_val const& v) const -> void { _s << val(v); }
+
+  auto operator()(array const& v) const -> void
+  {
+    _s << "[";
+    printList(val(v));
+    _s << "]";
+    printAttributes(attr(v));
+  }
+
+  auto operator()(arglist const& v) const -> void { printList(val(v)); }
+
+  auto operator()(structure const& v) const -> void
+  {
+    _s << "[";
+    for (auto it = val(v).begin(); it != val(v).end(); ++it) {
+      if (it != val(v).begin())
+        _s << ", ";
+      (*this)(it->first);
+      _s << ": ";
+      print(it->second);
+    }
+    _s << "]";
+    printAttributes(attr(v));
+  }
+
+  auto operator()(function const& v) const -> void
+  {
+    _s << "(";
+    for (auto it = val(v).first.begin(); it != val(v).first.end(); ++it) {
+      if (it != val(v).first.begin())
+        _s << ", ";
+      (*this)(*it);
+    }
+    _s << "){ ";
+    printLines(val(v).second);
+    _s << "}";
+    printAttributes(attr(v));
+  }
+
+  auto operator()(scope const& v) const -> void
+  {
+    _s << "{ ";
+    printLines(val(v));
+    _s << "}";
+    printAttributes(attr(v));
+  }
+
+  template <typename Op>
+  auto operator()(binary_op<Op> const& o) const -> void
+  {
+    printOp(o, [&] {
+      printOperand(val(o)[0]);
+      _s << " " << Op::str << " ";
+      printOperand(val(o)[1]);
+    });
+  }
+
+  auto operator()(binary_op<call> const& o) const -> void
+  {
+    printOp(o, [&] {
+      printOperand(val(o)[0]);
+      _s << "(";
+      print(val(o)[1]);
+      _s << ")";
+    });
+  }
+
+  auto operator()(binary_op<at> const& o) const -> void
+  {
+    printOp(o, [&] {
+      printOperand(val(o)[0]);
+      _s << "[";
+      print(val(o)[1]);
+      _s << "]";
+    });
+  }
+
+  auto operator()(binary_op<dot> const& o) const -> void { printMember(o); }
+  auto operator()(binary_op<odot> const& o) const -> void { printMember(o); }
+  auto operator()(binary_op<adot> const& o) const -> void { printMember(o); }
+
+  template <typename Op>
+  auto operator()(single_op<Op> const& o) const -> void
+  {
+    printOp(o, [&] {
+      _s << Op::str << " ";
+      printOperand(val(o)[0]);
+    });
+  }
+
+  auto operator()(ternary_op<cond> const& o) const -> void
+  {
+    printOp(o, [&] {
+      printOperand(val(o)[0]);
+      _s << " ? ";
+      printOperand(val(o)[1]);
+      _s << " : ";
+      printOperand(val(o)[2]);
+    });
+  }
+};  // class source_printer
+
+inline std::string toSource(expr const& tree)
+{
+  std::ostringstream ss;
+  boost::apply_visitor(source_printer(ss), tree);
+  return ss.str();
+}
+
+}  // namespace ast
+}  // namespace scopion
+
+#endif
@@ -29,6 +29,8 @@
 #include "scopion/error.hpp"
 
 #include <string>
+#include <type_traits>
+#include <utility>
 
 namespace scopion
 {
@@ -37,13 +39,13 @@ namespace ast
 template <typename T>
 T& val(value_wrapper<T>& w)
 {
-  return w.value;
+  return w.value.get();
 }
 
 template <typename T>
 const T& val(value_wrapper<T> const& w)
 {
-  return w.value;
+  return w.value.get();
 }
 
 template <typename T>
@@ -59,61 +61,24 @@ const attribute& attr(T const& w)
 
 namespace visitors_
 {
-class setter_visitor : boost::static_visitor<expr>
-{
-  std::function<void(attribute&)> f_;
-
-public:
+template <typename Attr>
+struct attr_visitor : boost::static_visitor<Attr&> {
   template <typename T>
-  setter_visitor(T f) : f_(f)
+  Attr& operator()(T& val) const
   {
+    return val.attr;
   }
 
-  template <typename T>
-  expr operator()(T val) const
+  Attr& operator()(std::conditional_t<std::is_const<Attr>::value, value const, value>& val) const
   {
-    f_(attr(val));
-    return val;
+    return boost::apply_visitor(*this, val);
   }
 
-  expr operator()(expr val) const { return boost::apply_visitor(*this, val); }
-
-  expr operator()(value val) const { return boost::apply_visitor(*this, val); }
-
-  expr operator()(operators val) const { return boost::apply_visitor(*this, val); }
-};
-
-class setter_recursive_visitor : boost::static_visitor<expr>
-{
-  std::function<void(attribute&)> f_;
-
-public:
-  template <typename T>
-  setter_recursive_visitor(T f) : f_(f)
-  {
-  }
-
-  template <typename Op, size_t N>
-  expr operator()(op<Op, N> val) const
+  Attr& operator()(
+      std::conditional_t<std::is_const<Attr>::value, operators const, operators>& val) const
   {
-    f_(attr(val));
-    std::for_each(ast::val(val).begin(), ast::val(val).end(),
-                  [this](auto& x) { x = boost::apply_visitor(*this, x); });
-    return val;
+    return boost::apply_visitor(*this, val);
   }
-
-  template <typename T>
-  expr operator()(T val) const
-  {
-    f_(attr(val));
-    return val;
-  }
-
-  expr operator()(expr val) const { return boost::apply_visitor(*this, val); }
-
-  expr operator()(value val) const { return boost::apply_visitor(*this, val); }
-
-  expr operator()(operators val) const { return boost::apply_visitor(*this, val); }
 };
 
 template <typename F, typename Result>
@@ -133,30 +98,39 @@ public:
   }
 };
 
+template <typename Dest>
+using holder_t = std::conditional_t<std::is_convertible<Dest, value>::value, value, operators>;
+
 }  // namespace visitors_
 
-template <typename T>
-expr set_lval(T t, bool val)
+inline attribute& attr(expr& t)
 {
-  return visitors_::setter_visitor([val](attribute& attr) { attr.lval = val; })(t);
+  return boost::apply_visitor(visitors_::attr_visitor<attribute>(), t);
+}
+inline attribute const& attr(expr const& t)
+{
+  return boost::apply_visitor(visitors_::attr_visitor<attribute const>(), t);
 }
 
 template <typename T>
-expr set_to_call(T t, bool val)
+T set_lval(T t, bool val)
 {
-  return visitors_::setter_visitor([val](attribute& attr) { attr.to_call = val; })(t);
+  attr(t).lval = val;
+  return t;
 }
 
 template <typename T>
-expr set_survey(T t, bool val)
+T set_to_call(T t, bool val)
 {
-  return visitors_::setter_recursive_visitor([val](attribute& attr) { attr.survey = val; })(t);
+  attr(t).to_call = val;
+  return t;
 }
 
 template <typename T>
-expr set_attr(T t, std::string const& key, std::string const& val)
+T set_attr(T t, std::string const& key, std::string const& val)
 {
-  return visitors_::setter_visitor([key, val](attribute& attr) { attr.attributes[key] = val; })(t);
+  attr(t).attributes[key] = val;
+  return t;
 }
 
 template <typename T>
@@ -166,20 +140,26 @@ T set_where(T val, locationInfo range)
   return val;
 }
 
-template <typename Dest, std::enable_if_t<std::is_convertible<Dest, value>::value>* = nullptr>
-Dest& unpack(expr t)
+template <typename Dest>
+Dest& unpack(expr& t)
+{
+  return boost::get<Dest>(boost::get<visitors_::holder_t<Dest>>(t));
+}
+
+template <typename Dest>
+Dest const& unpack(expr const& t)
 {
-  return boost::get<Dest>(boost::get<value>(t));
+  return boost::get<Dest>(boost::get<visitors_::holder_t<Dest>>(t));
 }
 
-template <typename Dest, std::enable_if_t<std::is_convertible<Dest, operators>::value>* = nullptr>
-Dest& unpack(expr t)
+template <typename Dest>
+Dest unpack(expr&& t)
 {
-  return boost::get<Dest>(boost::get<operators>(t));
+  return std::move(unpack<Dest>(t));
 }
 
 template <typename Dest>
-bool isa(expr t)
+bool isa(expr const& t)
 {
   if (t.type() == typeid(value))
     return boost::get<value>(t).type() == typeid(Dest);
@@ -190,7 +170,7 @@ bool isa(expr t)
 }
 
 template <typename Dest, typename F>
-decltype(auto) apply(F f, expr t)
+decltype(auto) apply(F f, expr const& t)
 {
   return boost::apply_visitor(visitors_::applier_visitor<decltype(f), Dest>(f), t);
 }
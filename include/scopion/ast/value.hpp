@@ -71,17 +71,17 @@ struct scope : array {
 using value = boost::variant<integer,
                              decimal,
                              boolean,
-                             boost::recursive_wrapper<string>,
-                             boost::recursive_wrapper<variable>,
-                             boost::recursive_wrapper<pre_variable>,
-                             boost::recursive_wrapper<identifier>,
-                             boost::recursive_wrapper<struct_key>,
-                             boost::recursive_wrapper<array>,
-                             boost::recursive_wrapper<arglist>,
-                             boost::recursive_wrapper<structure>,
-                             boost::recursive_wrapper<function>,
-                             boost::recursive_wrapper<scope>,
-                             boost::recursive_wrapper<attribute_val>>;
+                             string,
+                             variable,
+                             pre_variable,
+                             identifier,
+                             struct_key,
+                             array,
+                             arglist,
+                             structure,
+                             function,
+                             scope,
+                             attribute_val>;
 
 }  // namespace ast
 }  // namespace scopion
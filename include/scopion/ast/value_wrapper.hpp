@@ -22,9 +22,11 @@
 #ifndef SCOPION_AST_VALUE_WRAPPER_H_
 #define SCOPION_AST_VALUE_WRAPPER_H_
 
+#include "scopion/ast/arena.hpp"
 #include "scopion/ast/attribute.hpp"
 
 #include <type_traits>
+#include <utility>
 
 namespace scopion
 {
@@ -34,22 +36,23 @@ template <typename T>
 class value_wrapper
 {
 public:
-  T value;
+  node<T> value;
   attribute attr;
 
   value_wrapper(T const& val) : value(val) {}
+  value_wrapper(T&& val) : value(std::move(val)) {}
   template <typename U, std::enable_if_t<std::is_constructible<T, U>::value>* = nullptr>
-  value_wrapper(U const& val) : value(T(val))
+  value_wrapper(U&& val) : value(T(std::forward<U>(val)))
   {
   }
-  value_wrapper() : value(T()) {}
+  value_wrapper() : value() {}
 };
 template <class T>
 bool operator==(value_wrapper<T> const& lhs, value_wrapper<T> const& rhs);
 template <class T>
 bool operator<(value_wrapper<T> const& lhs, value_wrapper<T> const& rhs)
 {
-  return lhs.value < rhs.value;
+  return lhs.value.get() < rhs.value.get();
 }
 
 }  // namespace ast
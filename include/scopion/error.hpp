@@ -25,9 +25,12 @@
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
-#include <boost/range/adaptor/reversed.hpp>
-#include <boost/range/algorithm.hpp>
 #include <boost/range/iterator_range.hpp>
 
 #include <boost/filesystem/path.hpp>
@@ -59,38 +62,82 @@ static std::string getErrorTypeString(errorType et)
   }
 }
 
-struct locationInfo {
-  static strRange line_range(strRange const where, strRange const code)
+class sourceFile
+{
+  std::string code_;
+  boost::optional<boost::filesystem::path> path_;
+  mutable std::vector<uint32_t> line_starts_;
+  mutable std::once_flag line_starts_flag_;
+
+  std::vector<uint32_t> const& lineStarts() const
   {
-    auto range = boost::make_iterator_range(code.begin(), where.begin());
-    auto sol   = boost::find(range | boost::adaptors::reversed, '\n').base();
-    auto eol   = std::find(where.begin(), code.end(), '\n');
-    return boost::make_iterator_range(sol, eol);
+    std::call_once(line_starts_flag_, [this] {
+      line_starts_.push_back(0);
+      for (auto it = code_.begin(); it != code_.end(); it++)
+        if (*it == '\n')
+          line_starts_.push_back(static_cast<uint32_t>(std::distance(code_.begin(), it)) + 1);
+    });
+    return line_starts_;
   }
-  uint32_t line_number_;
-  uint32_t distance_;
-  std::string line_; /* should be string_view!? */
-  boost::optional<boost::filesystem::path> path_;
-  bool is_empty_;
 
 public:
-  locationInfo(strRange where, strRange code, boost::optional<boost::filesystem::path> const& path)
-      : path_(path), is_empty_(false)
+  sourceFile(std::string const& code, boost::optional<boost::filesystem::path> const& path)
+      : code_(code), path_(path)
+  {
+  }
+
+  sourceFile(sourceFile const&) = delete;
+  sourceFile& operator=(sourceFile const&) = delete;
+
+  std::string const& getCode() const { return code_; }
+  boost::optional<boost::filesystem::path> const& getPath() const { return path_; }
+
+  // 0-origin index of the line which contains offset
+  uint32_t getLineIndex(uint32_t offset) const
+  {
+    auto const& starts = lineStarts();
+    return static_cast<uint32_t>(
+        std::distance(starts.begin(), std::upper_bound(starts.begin(), starts.end(), offset)) - 1);
+  }
+  uint32_t getLineStart(uint32_t index) const { return lineStarts().at(index); }
+  std::string getLine(uint32_t index) const
+  {
+    auto const sol = code_.begin() + getLineStart(index);
+    return std::string(sol, std::find(sol, code_.end(), '\n'));
+  }
+};
+
+// A position in a parsed file. It shares the ownership of the file's code, which stays alive as
+// long as something refers to it (errors from imported modules are printed after their code has
+// gone out of scope)
+class locationInfo
+{
+  std::shared_ptr<sourceFile const> file_;
+  uint32_t offset_;
+
+public:
+  locationInfo(std::shared_ptr<sourceFile const> file, uint32_t offset)
+      : file_(std::move(file)), offset_(offset)
   {
-    line_number_ = static_cast<uint32_t>(std::count(code.begin(), where.begin(), '\n')) + 1;
-    auto r       = line_range(where, code);
-    line_        = std::string(r.begin(), r.end());
-    distance_    = static_cast<uint32_t>(std::distance(r.begin(), where.begin()));
   }
 
-  locationInfo() : is_empty_(true) {}
+  locationInfo() : offset_(0) {}
 
-  uint32_t getLineNumber() const { return line_number_; }
-  std::string getLineContent() const { return line_; }
-  boost::optional<boost::filesystem::path> getPath() const { return path_; }
-  std::string getPathString() const { return path_ ? path_->string() : "<not a file>"; }
-  uint32_t getColumnNumber() const { return distance_; }
-  bool isEmpty() const { return is_empty_; }
+  std::shared_ptr<sourceFile const> const& getFile() const { return file_; }
+  uint32_t getOffset() const { return offset_; }
+  uint32_t getLineNumber() const { return file_->getLineIndex(offset_) + 1; }
+  std::string getLineContent() const { return file_->getLine(file_->getLineIndex(offset_)); }
+  boost::optional<boost::filesystem::path> getPath() const { return file_->getPath(); }
+  std::string getPathString() const
+  {
+    auto const& path = file_->getPath();
+    return path ? path->string() : "<not a file>";
+  }
+  uint32_t getColumnNumber() const
+  {
+    return offset_ - file_->getLineStart(file_->getLineIndex(offset_));
+  }
+  bool isEmpty() const { return !file_; }
 };
 
 class error
@@ -0,0 +1,260 @@
+/**
+* @file profiler.hpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCOPION_PROFILER_H_
+#define SCOPION_PROFILER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace scopion
+{
+// Records how long each phase of a compilation takes, when enabled
+class profiler
+{
+public:
+  struct event {
+    std::string category;
+    std::string name;
+    size_t thread;  // numbered in the order threads first record an event
+    int64_t start_us;
+    int64_t wall_us;
+    int64_t cpu_us;
+    int64_t peak_rss_kb;  // of the whole process, when the event ended
+  };
+
+private:
+  std::vector<event> events_;
+  std::map<std::thread::id, size_t> threads_;
+  std::mutex mutex_;
+  bool enabled_ = false;
+  std::chrono::steady_clock::time_point const origin_ = std::chrono::steady_clock::now();
+
+  profiler()  = default;
+  ~profiler() = default;
+
+  static std::string escape(std::string const& s)
+  {
+    std::string res;
+    for (char c : s) {
+      if (c == '"' || c == '\\') {
+        res += '\\';
+        res += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+        res += buf;
+      } else {
+        res += c;
+      }
+    }
+    return res;
+  }
+
+  // The wall and cpu time of each event spent outside the events nested in it on its thread,
+  // in the order of events_
+  std::vector<std::pair<int64_t, int64_t>> selfTimes() const
+  {
+    std::vector<size_t> order(events_.size());
+    for (size_t i = 0; i < order.size(); i++)
+      order[i] = i;
+    // an enclosing event starts no later and, when it starts at the same time, lasts longer
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+      auto const& ea = events_[a];
+      auto const& eb = events_[b];
+      return std::make_tuple(ea.thread, ea.start_us, -ea.wall_us) <
+             std::make_tuple(eb.thread, eb.start_us, -eb.wall_us);
+    });
+
+    std::vector<std::pair<int64_t, int64_t>> self;
+    for (auto const& e : events_)
+      self.emplace_back(e.wall_us, e.cpu_us);
+
+    std::vector<size_t> open;
+    for (auto const i : order) {
+      auto const& e = events_[i];
+      while (!open.empty()) {
+        auto const& outer = events_[open.back()];
+        if (outer.thread == e.thread && e.start_us < outer.start_us + outer.wall_us)
+          break;  // e is nested in outer
+        open.pop_back();
+      }
+      if (!open.empty()) {
+        self[open.back()].first -= e.wall_us;
+        self[open.back()].second -= e.cpu_us;
+      }
+      open.push_back(i);
+    }
+    return self;
+  }
+
+public:
+  profiler(profiler const&) = delete;
+  profiler& operator=(profiler const&) = delete;
+  profiler(profiler&&)                 = delete;
+  profiler& operator=(profiler&&) = delete;
+
+  static profiler& getInstance()
+  {
+    static profiler instance;
+    return instance;
+  }
+
+  void enable() { enabled_ = true; }
+  bool isEnabled() const { return enabled_; }
+
+  int64_t now() const
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                 origin_)
+        .count();
+  }
+
+  static int64_t threadCPUTime()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  static int64_t peakRSS()
+  {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // in bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+  }
+
+  void record(event e, std::thread::id thread)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    e.thread = threads_.emplace(thread, threads_.size()).first->second;
+    events_.push_back(std::move(e));
+  }
+
+  // Totals of self time per phase, the slowest first, so that nested events are not counted
+  // twice
+  void printTable(std::ostream& os)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const self = selfTimes();
+    std::map<std::pair<std::string, std::string>, std::tuple<size_t, int64_t, int64_t, int64_t>>
+        totals;
+    for (size_t i = 0; i < events_.size(); i++) {
+      auto const& e = events_[i];
+      auto& t       = totals[{e.category, e.name}];
+      std::get<0>(t)++;
+      std::get<1>(t) += self[i].first;
+      std::get<2>(t) += self[i].second;
+      std::get<3>(t) = std::max(std::get<3>(t), e.peak_rss_kb);
+    }
+
+    std::vector<std::pair<std::pair<std::string, std::string>,
+                          std::tuple<size_t, int64_t, int64_t, int64_t>>>
+        rows(totals.begin(), totals.end());
+    std::stable_sort(rows.begin(), rows.end(), [](auto const& a, auto const& b) {
+      return std::get<1>(a.second) > std::get<1>(b.second);
+    });
+
+    auto const flags = os.flags();
+    os << std::left << std::setw(12) << "kind" << std::setw(40) << "name" << std::right
+       << std::setw(8) << "count" << std::setw(16) << "self wall (ms)" << std::setw(16)
+       << "self cpu (ms)" << std::setw(28) << "process peak RSS (KB)" << std::endl;
+    for (auto const& r : rows) {
+      os << std::left << std::setw(12) << r.first.first << std::setw(40) << r.first.second
+         << std::right << std::setw(8) << std::get<0>(r.second) << std::fixed
+         << std::setprecision(3) << std::setw(16) << std::get<1>(r.second) / 1000.0
+         << std::setw(16) << std::get<2>(r.second) / 1000.0 << std::setw(28)
+         << std::get<3>(r.second) << std::endl;
+    }
+    os.flags(flags);
+  }
+
+  // Every event in the trace_event format, as loaded by chrome://tracing
+  void writeChromeTrace(std::ostream& os)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    os << "{\"traceEvents\":[";
+    for (auto it = events_.begin(); it != events_.end(); ++it) {
+      if (it != events_.begin())
+        os << ",";
+      os << "\n{\"name\":\"" << escape(it->name) << "\",\"cat\":\"" << escape(it->category)
+         << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << it->thread << ",\"ts\":" << it->start_us
+         << ",\"dur\":" << it->wall_us << ",\"args\":{\"cpu_us\":" << it->cpu_us
+         << ",\"peak_rss_kb\":" << it->peak_rss_kb << "}}";
+    }
+    os << "\n]}" << std::endl;
+  }
+};
+
+// Records the time from its construction to its destruction as an event
+class profileScope
+{
+  bool enabled_;
+  profiler::event event_;
+  int64_t cpu_start_;
+
+public:
+  // Nothing is copied unless profiling is enabled; a name that takes work to build should be
+  // built only if profiler::getInstance().isEnabled()
+  profileScope(char const* category, std::string const& name)
+      : enabled_(profiler::getInstance().isEnabled())
+  {
+    if (!enabled_)
+      return;
+    event_.category = category;
+    event_.name     = name;
+    event_.start_us = profiler::getInstance().now();
+    cpu_start_      = profiler::threadCPUTime();
+  }
+
+  ~profileScope()
+  {
+    if (!enabled_)
+      return;
+    event_.wall_us     = profiler::getInstance().now() - event_.start_us;
+    event_.cpu_us      = profiler::threadCPUTime() - cpu_start_;
+    event_.peak_rss_kb = profiler::peakRSS();
+    profiler::getInstance().record(std::move(event_), std::this_thread::get_id());
+  }
+
+  profileScope(profileScope const&) = delete;
+  profileScope& operator=(profileScope const&) = delete;
+};
+}  // namespace scopion
+
+#endif  // SCOPION_PROFILER_H_
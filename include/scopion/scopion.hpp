@@ -29,5 +29,6 @@
 #include "scopion/parser/parser.hpp"
 
 #include "scopion/error.hpp"
+#include "scopion/profiler.hpp"
 
 #endif
@@ -155,7 +155,7 @@ install_depends() {
     Linux)
       case $TARGET_OS in
         *Ubuntu*|*Debian*)
-          execmdsu "apt-get -y --allow-unauthenticated install clang-${LLVM_VERSION} llvm-${LLVM_VERSION} libgc-dev exuberant-ctags libboost-filesystem-dev"
+          execmdsu "apt-get -y --allow-unauthenticated install clang-${LLVM_VERSION} llvm-${LLVM_VERSION} libclang-${LLVM_VERSION}-dev libgc-dev libboost-filesystem-dev"
           execmdsu "update-alternatives --install /usr/local/bin/clang clang `which clang-${LLVM_VERSION}` 10"
           execmdsu "update-alternatives --install /usr/local/bin/llc llc `which llc-${LLVM_VERSION}` 10"
           ;;
@@ -163,7 +163,6 @@ install_depends() {
       ;;
     Darwin)
       execmd "brew list cmake &> /dev/null || brew install cmake"
-      execmd "brew list ctags &> /dev/null || brew install ctags"
       execmd "brew list boost &> /dev/null || brew install boost"
       execmd "brew list llvm &> /dev/null || brew install llvm"
       execmd "brew list bdw-gc &> /dev/null || brew install bdw-gc"
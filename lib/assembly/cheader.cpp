@@ -0,0 +1,280 @@
+/**
+* @file cheader.cpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scopion/assembly/cheader.hpp"
+#include "scopion/assembly/object_cache.hpp"
+
+#include "scopion/config.hpp"
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/AST/GlobalDecl.h>
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/CodeGen/ModuleBuilder.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendAction.h>
+#include <clang/Frontend/TextDiagnosticPrinter.h>
+#include <clang/Frontend/Utils.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+
+namespace scopion
+{
+namespace assembly
+{
+namespace
+{
+std::string readFile(boost::filesystem::path const& path)
+{
+  std::ifstream ifs(path.string(), std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+// Functions that are never imported: reserved names, and ones known to break linking
+bool isExcluded(clang::FunctionDecl const& f)
+{
+  static std::set<std::string> const names = {"tmpnam",  "tempnam", "tmpnam_r", "tempnam_r",
+                                              "zopen",   "alloca",  "revoke",   "setlogin",
+                                              "getwd",   "mktemp"};
+  if (!f.getIdentifier() || !f.isExternallyVisible() || f.isInlined() || f.getBuiltinID())
+    return true;
+  auto const name = f.getName();
+  return name.startswith("_") || names.count(name.str()) != 0;
+}
+
+// Hands the AST to clang's code generator, declaring every function of the header in the
+// module on the way. The files the header includes are reported to deps.
+class declaring_consumer : public clang::ASTConsumer
+{
+  std::unique_ptr<clang::CodeGenerator> codegen_;
+  std::vector<clang::FunctionDecl*> functions_;
+  std::unique_ptr<llvm::Module>& module_;
+  std::vector<std::string>& deps_;
+
+public:
+  declaring_consumer(std::unique_ptr<clang::CodeGenerator> codegen,
+                     std::unique_ptr<llvm::Module>& module,
+                     std::vector<std::string>& deps)
+      : codegen_(std::move(codegen)), module_(module), deps_(deps)
+  {
+  }
+
+  void Initialize(clang::ASTContext& context) override { codegen_->Initialize(context); }
+
+  bool HandleTopLevelDecl(clang::DeclGroupRef group) override
+  {
+    for (auto* d : group) {
+      if (auto* f = llvm::dyn_cast<clang::FunctionDecl>(d)) {
+        if (!isExcluded(*f))
+          functions_.push_back(f);
+      }
+    }
+    return codegen_->HandleTopLevelDecl(group);
+  }
+
+  void HandleTagDeclDefinition(clang::TagDecl* d) override { codegen_->HandleTagDeclDefinition(d); }
+
+  void HandleTranslationUnit(clang::ASTContext& context) override
+  {
+    for (auto* f : functions_)
+      codegen_->GetAddrOfGlobal(clang::GlobalDecl(f), false);
+    codegen_->HandleTranslationUnit(context);
+    module_.reset(codegen_->ReleaseModule());
+
+    auto const& sm = context.getSourceManager();
+    for (auto it = sm.fileinfo_begin(); it != sm.fileinfo_end(); ++it) {
+      if (boost::filesystem::exists(it->first->getName().str()))
+        deps_.push_back(boost::filesystem::canonical(it->first->getName().str()).string());
+    }
+  }
+};
+
+class declaring_action : public clang::ASTFrontendAction
+{
+  llvm::LLVMContext& context_;
+  std::unique_ptr<llvm::Module> module_;
+  std::vector<std::string> deps_;
+
+protected:
+  std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance& ci,
+                                                        llvm::StringRef file) override
+  {
+    std::unique_ptr<clang::CodeGenerator> codegen(
+        clang::CreateLLVMCodeGen(ci.getDiagnostics(), file, ci.getHeaderSearchOpts(),
+                                 ci.getPreprocessorOpts(), ci.getCodeGenOpts(), context_));
+    return std::make_unique<declaring_consumer>(std::move(codegen), module_, deps_);
+  }
+
+public:
+  explicit declaring_action(llvm::LLVMContext& context) : context_(context) {}
+
+  std::unique_ptr<llvm::Module> takeModule() { return std::move(module_); }
+  std::vector<std::string> const& getDependencies() const { return deps_; }
+};
+
+// A dependency is unchanged if its size and modification time are as recorded, or else if its
+// contents still hash to the recorded digest
+bool isUnchanged(std::string const& path,
+                 std::string const& digest,
+                 uintmax_t size,
+                 std::time_t mtime)
+{
+  boost::system::error_code ec;
+  auto const actual_size = boost::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  if (actual_size == size && boost::filesystem::last_write_time(path, ec) == mtime && !ec)
+    return true;
+  return object_cache::hash({readFile(path)}) == digest;
+}
+
+std::shared_ptr<std::string const> loadCached(boost::filesystem::path const& dir)
+{
+  std::ifstream deps((dir / "deps").string());
+  if (deps.fail())
+    return nullptr;
+
+  std::string digest, path;
+  uintmax_t size;
+  std::time_t mtime;
+  while (deps >> digest >> size >> mtime && std::getline(deps >> std::ws, path)) {
+    if (!isUnchanged(path, digest, size, mtime))
+      return nullptr;
+  }
+
+  std::ifstream bitcode((dir / "bitcode").string(), std::ios::binary);
+  if (bitcode.fail())
+    return nullptr;
+  return std::make_shared<std::string const>((std::istreambuf_iterator<char>(bitcode)),
+                                             std::istreambuf_iterator<char>());
+}
+
+void store(boost::filesystem::path const& dir,
+           std::vector<std::string> const& dependencies,
+           std::string const& bitcode)
+{
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(dir, ec);
+  if (ec)
+    return;  // caching is best-effort
+
+  {
+    std::ofstream deps((dir / "deps.tmp").string());
+    for (auto const& d : dependencies) {
+      auto const size = boost::filesystem::file_size(d, ec);
+      if (ec)
+        return;
+      auto const mtime = boost::filesystem::last_write_time(d, ec);
+      if (ec)
+        return;
+      deps << object_cache::hash({readFile(d)}) << ' ' << size << ' ' << mtime << ' ' << d << '\n';
+    }
+    std::ofstream out((dir / "bitcode.tmp").string(), std::ios::binary);
+    out.write(bitcode.data(), static_cast<std::streamsize>(bitcode.size()));
+    if (!deps.flush() || !out.flush())
+      return;
+  }
+  // loadCached() reads deps first, and an entry with deps of the old files is never valid: the
+  // entry becomes visible only once deps is renamed, after the bitcode is in place
+  boost::filesystem::rename(dir / "bitcode.tmp", dir / "bitcode", ec);
+  if (ec)
+    return;
+  boost::filesystem::rename(dir / "deps.tmp", dir / "deps", ec);
+}
+}  // namespace
+
+std::string getCHeaderCachePath(std::string const& header,
+                                std::vector<std::string> const& include_dirs)
+{
+  std::vector<std::string> key = {SCOPION_VERSION, LLVM_VERSION_STRING, header};
+  key.insert(key.end(), include_dirs.begin(), include_dirs.end());
+  return (object_cache::directory() / "cheaders" / object_cache::hash(key) / "bitcode").string();
+}
+
+std::shared_ptr<std::string const> compileCHeader(std::string const& header,
+                                                  std::vector<std::string> const& include_dirs)
+{
+  auto const dir = boost::filesystem::path(getCHeaderCachePath(header, include_dirs)).parent_path();
+  if (auto cached = loadCached(dir))
+    return cached;
+
+  auto const source = "scopion-cheader.c";
+  std::vector<std::string> args = {"clang", "-fsyntax-only", "-w", "-x", "c", source,
+                                   "-resource-dir", SCOPION_CLANG_RESOURCE_DIR};
+  for (auto const& d : include_dirs) {
+    args.push_back("-I");
+    args.push_back(d);
+  }
+  std::vector<char const*> argv;
+  for (auto const& a : args)
+    argv.push_back(a.c_str());
+
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagopts(new clang::DiagnosticOptions);
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticsEngine> diags(new clang::DiagnosticsEngine(
+      new clang::DiagnosticIDs, diagopts.get(),
+      new clang::TextDiagnosticPrinter(llvm::errs(), diagopts.get())));
+
+  std::shared_ptr<clang::CompilerInvocation> invocation =
+      clang::createInvocationFromCommandLine(argv, diags);
+  if (!invocation)
+    return nullptr;
+  invocation->getPreprocessorOpts().addRemappedFile(
+      source, llvm::MemoryBuffer::getMemBufferCopy("#include \"" + header + "\"\n").release());
+
+  clang::CompilerInstance ci;
+  ci.setInvocation(std::move(invocation));
+  ci.setDiagnostics(diags.get());
+
+  llvm::LLVMContext context;
+  declaring_action action(context);
+  if (!ci.ExecuteAction(action))
+    return nullptr;
+  auto module = action.takeModule();
+  if (!module)
+    return nullptr;
+
+  auto bitcode = std::make_shared<std::string>();
+  {
+    llvm::raw_string_ostream stream(*bitcode);
+    llvm::WriteBitcodeToFile(module.get(), stream);
+  }
+  store(dir, action.getDependencies(), *bitcode);
+  return bitcode;
+}
+
+}  // namespace assembly
+}  // namespace scopion
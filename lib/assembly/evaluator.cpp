@@ -26,10 +26,12 @@
 #include "scopion/ast/expr.hpp"
 #include "scopion/ast/util.hpp"
 #include "scopion/ast/value.hpp"
+#include "scopion/profiler.hpp"
 
 #include <llvm/AsmParser/Parser.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
@@ -38,6 +40,7 @@
 
 #include <boost/range/adaptor/indexed.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 #include <vector>
@@ -48,8 +51,8 @@ namespace assembly
 {
 std::pair<bool, value*> apply_bb(ast::scope const& sc, translator& tr)
 {
-  auto insts = ast::val(sc);
-  value* ll  = nullptr;
+  auto& insts = ast::val(sc);
+  value* ll   = nullptr;
   for (auto it = insts.begin(); it != insts.end(); it++) {
     ll = boost::apply_visitor(tr, *it);
   }
@@ -62,11 +65,104 @@ std::pair<bool, value*> apply_bb(ast::scope const& sc, translator& tr)
                         ll);
 }
 
+// Flattens what a specialization depends on besides llvm types: member names (structures of the
+// same layout share one llvm type) and the identity of lazy values, whose bodies are inlined
+static void collectShape(value const* v,
+                         std::string const& name,
+                         std::vector<std::pair<std::string, llvm::Value*>>& shape)
+{
+  if (v->getType()->isLazy()) {
+    shape.emplace_back(name, v->getLLVM());
+    return;
+  }
+  shape.emplace_back(name, nullptr);
+  for (auto const& s : v->symbols())
+    collectShape(s.second, name + "." + s.first, shape);
+}
+
+// Finds the type of values returned by the lowered body, or nullptr if it has no return
+static llvm::Type* inferReturnType(llvm::Function* func, ast::function const& fcv)
+{
+  llvm::Type* ret_type = nullptr;
+  for (auto const& bb : *func) {
+    for (auto itr = bb.getInstList().begin(); itr != bb.getInstList().end(); ++itr) {
+      if ((*itr).getOpcode() == llvm::Instruction::Ret) {
+        if ((*itr).getOperand(0)->getType() != ret_type) {
+          if (ret_type == nullptr) {
+            ret_type = (*itr).getOperand(0)->getType();
+          } else {
+            throw error("All return values must have the same type", ast::attr(fcv).where,
+                        errorType::Translate);
+          }
+        }
+      }
+    }
+  }
+  return ret_type;
+}
+
+// Moves the body of func into a new function returning ret_type and erases func
+static llvm::Function* retypeFunction(llvm::Function* func,
+                                      llvm::Type* ret_type,
+                                      llvm::AllocaInst* selfptr)
+{
+  auto newfunc = llvm::Function::Create(
+      llvm::FunctionType::get(ret_type, func->getFunctionType()->params(), false),
+      func->getLinkage(), "", func->getParent());
+  newfunc->takeName(func);
+  newfunc->getBasicBlockList().splice(newfunc->begin(), func->getBasicBlockList());
+
+  auto nait = newfunc->arg_begin();
+  for (auto& arg : func->args()) {
+    arg.replaceAllUsesWith(&(*nait));
+    nait++;
+  }
+
+  // @self is declared again with the new signature, and the calls through it call newfunc
+  auto store = llvm::cast<llvm::StoreInst>(
+      *std::find_if(selfptr->user_begin(), selfptr->user_end(),
+                    [](llvm::User* u) { return llvm::isa<llvm::StoreInst>(u); }));
+  llvm::IRBuilder<> builder(store);
+  auto newself = builder.CreateAlloca(newfunc->getType(), nullptr);
+  newself->takeName(selfptr);
+  builder.CreateStore(newfunc, newself);
+  store->eraseFromParent();
+
+  std::vector<llvm::User*> const loads(selfptr->user_begin(), selfptr->user_end());
+  for (auto load : loads) {
+    std::vector<llvm::User*> const users(load->user_begin(), load->user_end());
+    for (auto user : users) {
+      auto call = llvm::dyn_cast<llvm::CallInst>(user);
+      if (!call || call->getCalledValue() != load)
+        continue;
+      // the old return type is void, so the result of the call is never used
+      builder.SetInsertPoint(call);
+      builder.CreateCall(newfunc, std::vector<llvm::Value*>(call->arg_begin(), call->arg_end()));
+      call->eraseFromParent();
+    }
+    if (!load->use_empty()) {  // @self used as a value
+      builder.SetInsertPoint(llvm::cast<llvm::Instruction>(load));
+      load->replaceAllUsesWith(
+          builder.CreateBitCast(builder.CreateLoad(newself), load->getType()));
+    }
+    llvm::cast<llvm::Instruction>(load)->eraseFromParent();
+  }
+  selfptr->eraseFromParent();
+
+  func->eraseFromParent();
+  return newfunc;
+}
+
 evaluator::evaluator(value* v, std::vector<value*> const& args, translator& tr)
     : v_(v), arguments_(args), translator_(tr), builder_(tr.builder_)
 {
 }
 
+value* evaluator::makeVoid()
+{
+  return translator_.region_->makeValue();
+}
+
 value* evaluator::operator()(ast::value const& astv)
 {
   return boost::apply_visitor(*this, astv);
@@ -135,6 +231,8 @@ value* evaluator::operator()(ast::function const& fcv)
 
   std::vector<llvm::Type*> arg_types;
   std::vector<llvm::Type*> arg_types_for_func;
+  std::vector<llvm::Type*> arg_types_supplied;
+  std::vector<std::pair<std::string, llvm::Value*>> arg_shape;
 
   for (auto const v : arguments_ | boost::adaptors::indexed()) {
     auto type = v.value()->getType()->getLLVM();
@@ -147,62 +245,67 @@ value* evaluator::operator()(ast::function const& fcv)
       arg_types_for_func.push_back(type);
     arg_types.push_back(v.value()->getType()->isFundamental() ? type
                                                               : type->getPointerElementType());
+    arg_types_supplied.push_back(type);
+    collectShape(v.value(), std::to_string(v.index()), arg_shape);
   }
 
+  // Reuse the specialization made for the same literal with the same arguments
+  auto const key =
+      std::make_tuple(v_->getLLVM(), std::move(arg_types_supplied), std::move(arg_shape));
+  auto const cached = translator_.specializations_.find(key);
+  if (cached != translator_.specializations_.end())
+    return cached->second;
+
+  profileScope timing("specialize", profiler::getInstance().isEnabled()
+                                        ? v_->getLLVM()->getName().str()
+                                        : std::string());
+
+  // The return type is not known until the body is lowered; start with the declared one (or void)
+  // and move the body into a function of the inferred type afterwards
   llvm::FunctionType* func_type =
       llvm::FunctionType::get(retst ? retst : builder_.getVoidTy(), arg_types_for_func, false);
   llvm::Function* func =
       llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, v_->getLLVM()->getName(),
                              translator_.module_->getLLVMModule());
   llvm::BasicBlock* entry =
-      llvm::BasicBlock::Create(translator_.module_->getContext(), "entry_survey", func);
+      llvm::BasicBlock::Create(translator_.module_->getContext(), "entry", func);
   auto prevScope = translator_.getScope();
-  translator_.setScope(new value(entry, fcv));
+  translator_.setScope(translator_.region_->makeValue(entry, fcv));
 
   auto pb = builder_.GetInsertBlock();
   auto pp = builder_.GetInsertPoint();
 
   builder_.SetInsertPoint(entry);
 
-  translator_.getScope()->symbols()["__self"] =
-      new value(builder_.CreateAlloca(func->getType(), nullptr, "__self"), fcv);
+  auto selfptr = builder_.CreateAlloca(func->getType(), nullptr, "__self");
+  translator_.getScope()->symbols()["__self"] = translator_.region_->makeValue(selfptr, fcv);
+  builder_.CreateStore(func, selfptr);
 
+  auto ait = func->arg_begin();
   for (auto const arg_name : arg_names | boost::adaptors::indexed()) {
     auto ulindex = static_cast<unsigned long>(arg_name.index());
-    auto vp      = arguments_[ulindex];
-    if (!vp->getType()->isLazy()) {
-      translator_.getScope()->symbols()[arg_name.value()] =
-          vp->copyWithNewLLVMValue(builder_.CreateAlloca(arg_types[ulindex], nullptr,
-                                                         arg_name.value()));  // declare arguments
+    auto argv    = arguments_[ulindex];
+    if (!argv->getType()->isLazy()) {
+      auto aptr = builder_.CreateAlloca(arg_types[ulindex], nullptr,
+                                        arg_name.value());  // declare arguments
+      translator_.getScope()->symbols()[arg_name.value()] = argv->copyWithNewLLVMValue(aptr);
+      builder_.CreateStore(argv->getType()->isFundamental() ? static_cast<llvm::Value*>(&(*ait))
+                                                            : builder_.CreateLoad(&(*ait)),
+                           aptr);
+      ait++;
     } else {
-      translator_.getScope()->symbols()[arg_name.value()] = vp;
+      translator_.getScope()->symbols()[arg_name.value()] = argv;
     }
   }
 
   ret_table_t* ret_table = nullptr;
   for (auto const& line : ast::val(fcv).second) {
-    auto e = ast::set_survey(line, true);
-    auto v = boost::apply_visitor(translator_, e);
+    auto v = boost::apply_visitor(translator_, line);
     if (!ret_table)
       ret_table = v->getRetTable();
   }
 
-  llvm::Type* ret_type = nullptr;
-  for (auto const& bb : *func) {
-    for (auto itr = bb.getInstList().begin(); itr != bb.getInstList().end(); ++itr) {
-      if ((*itr).getOpcode() == llvm::Instruction::Ret) {
-        if ((*itr).getOperand(0)->getType() != ret_type) {
-          if (ret_type == nullptr) {
-            ret_type = (*itr).getOperand(0)->getType();
-          } else {
-            throw error("All return values must have the same type", ast::attr(fcv).where,
-                        errorType::Translate);
-          }
-        }
-      }
-    }
-  }
-
+  auto ret_type = inferReturnType(func, fcv);
   if (!ret_type) {
     builder_.CreateRetVoid();
     ret_type = builder_.getVoidTy();
@@ -214,63 +317,14 @@ value* evaluator::operator()(ast::function const& fcv)
                 ast::attr(fcv).where, errorType::Translate);
   }
 
-  func->eraseFromParent();  // remove old one
-
-  llvm::Function* newfunc;
-  if (ast::attr(fcv).survey) {  // is it really ok?
-    newfunc = llvm::Function::Create(llvm::FunctionType::get(ret_type, arg_types_for_func, false),
-                                     llvm::Function::ExternalLinkage);
-  } else {  // Create the real content of function if it
-            // isn't in survey
-
-    newfunc = llvm::Function::Create(llvm::FunctionType::get(ret_type, arg_types_for_func, false),
-                                     llvm::Function::ExternalLinkage, v_->getLLVM()->getName(),
-                                     translator_.module_->getLLVMModule());
-
-    llvm::BasicBlock* newentry =
-        llvm::BasicBlock::Create(translator_.module_->getContext(), "entry", newfunc);
-
-    translator_.setScope(new value(newentry, fcv));
-    builder_.SetInsertPoint(newentry);
-
-    auto selfptr = builder_.CreateAlloca(newfunc->getType(), nullptr, "__self");
-    translator_.getScope()->symbols()["__self"] = new value(selfptr, fcv);
-    builder_.CreateStore(newfunc, selfptr);
-
-    auto ait = newfunc->arg_begin();
-    for (auto const arg_name : arg_names | boost::adaptors::indexed()) {
-      auto ulindex = static_cast<unsigned long>(arg_name.index());
-      auto argv    = arguments_[ulindex];
-      if (!argv->getType()->isLazy()) {
-        auto aptr = builder_.CreateAlloca(arg_types[ulindex], nullptr,
-                                          arg_name.value());  // declare arguments
-        translator_.getScope()->symbols()[arg_name.value()] = argv->copyWithNewLLVMValue(aptr);
-        builder_.CreateStore(argv->getType()->isFundamental() ? static_cast<llvm::Value*>(&(*ait))
-                                                              : builder_.CreateLoad(&(*ait)),
-                             aptr);
-        ait++;
-      } else {
-        // std::cout << arg_name.value() << " is lazy" << std::endl;
-        translator_.getScope()->symbols()[arg_name.value()] = argv;
-      }
-    }
-
-    for (auto const& line : ast::val(fcv).second) {
-      boost::apply_visitor(translator_, line);
-    }
-
-    if (ret_type->isVoidTy()) {
-      builder_.CreateRetVoid();
-    }
-  }
+  auto newfunc = ret_type == func->getReturnType() ? func : retypeFunction(func, ret_type, selfptr);
 
   translator_.setScope(prevScope);
   builder_.SetInsertPoint(pb, pp);
 
-  // value.getValue()->eraseFromParent();
-
-  auto destv = new value(newfunc, fcv);
+  auto destv = translator_.region_->makeValue(newfunc, fcv);
   destv->setRetTable(ret_table);
+  translator_.specializations_[key] = destv;
   return destv;
 }
 
@@ -0,0 +1,79 @@
+/**
+* @file import_cache.cpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scopion/assembly/import_cache.hpp"
+#include "scopion/assembly/cheader.hpp"
+
+#include <fstream>
+#include <iterator>
+
+namespace scopion
+{
+namespace assembly
+{
+static std::shared_ptr<std::string const> readFile(std::string const& path)
+{
+  std::ifstream ifs(path, std::ios::binary);
+  if (ifs.fail())
+    return nullptr;
+  return std::make_shared<std::string const>((std::istreambuf_iterator<char>(ifs)),
+                                             std::istreambuf_iterator<char>());
+}
+
+import_cache::contents_t import_cache::get(std::string const& key,
+                                           std::function<contents_t()> const& produce)
+{
+  std::promise<contents_t> promise;
+  std::shared_future<contents_t> future;
+  bool producer = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      future = it->second;
+    } else {
+      future   = promise.get_future().share();
+      producer = true;
+      entries_.emplace(key, future);
+    }
+  }
+  // the others wait for the first one asking, instead of doing the same work
+  if (producer)
+    promise.set_value(produce());
+  return future.get();
+}
+
+import_cache::contents_t import_cache::getFile(std::string const& path)
+{
+  return get("file:" + path, [&path] { return readFile(path); });
+}
+
+import_cache::contents_t import_cache::getCHeaderIR(std::string const& header,
+                                                    std::vector<std::string> const& include_dirs)
+{
+  auto key = "cheader:" + header;
+  for (auto const& d : include_dirs)
+    key += ":" + d;
+  return get(key, [&] { return compileCHeader(header, include_dirs); });
+}
+
+}  // namespace assembly
+}  // namespace scopion
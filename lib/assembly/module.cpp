@@ -27,29 +27,226 @@
 #include <llvm/Analysis/CallGraphSCCPass.h>
 #include <llvm/Analysis/LoopPass.h>
 #include <llvm/Analysis/RegionPass.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/Interpreter.h>
+#include <llvm/ExecutionEngine/JITSymbol.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/IRTransformLayer.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Mangler.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/InitializePasses.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Pass.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/TargetRegistry.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ThreadPool.h>
 #include <llvm/Support/raw_os_ostream.h>
 #include <llvm/Support/raw_ostream.h>
-#include <llvm/Transforms/IPO.h>
-#include <llvm/Transforms/IPO/AlwaysInliner.h>
-#include <llvm/Transforms/IPO/Inliner.h>
-#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
 #include <numeric>
+#include <set>
 #include <string>
 
 namespace scopion
 {
 namespace assembly
 {
+namespace
+{
+// Upper bound of the partitions module::emitSplit makes
+constexpr std::ptrdiff_t max_partitions = 8;
+
+// Which part of the optimization a pipeline performs
+enum class pipeline {
+  whole,       // everything, over a module that is not split
+  pre_split,   // inlining and simplification, over the module before it is split
+  post_split,  // the rest, over each partition
+};
+
+// Runs the default pipeline of the new pass manager over m, at -O<optLevel>, or at -Os/-Oz when
+// sizeLevel is 1/2. Nothing is done at -O0.
+void runOptimizationPipeline(llvm::Module& m,
+                             uint8_t optLevel,
+                             uint8_t sizeLevel,
+                             llvm::TargetMachine* machine = nullptr,
+                             pipeline phase               = pipeline::whole)
+{
+  if (!optLevel)
+    return;
+
+  auto level = llvm::PassBuilder::O3;
+  if (sizeLevel)
+    level = sizeLevel == 1 ? llvm::PassBuilder::Os : llvm::PassBuilder::Oz;
+  else if (optLevel < 3)
+    level = optLevel == 1 ? llvm::PassBuilder::O1 : llvm::PassBuilder::O2;
+
+  llvm::PassBuilder builder(machine);
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+  builder.registerModuleAnalyses(mam);
+  builder.registerCGSCCAnalyses(cgam);
+  builder.registerFunctionAnalyses(fam);
+  builder.registerLoopAnalyses(lam);
+  builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  switch (phase) {
+    case pipeline::whole:
+      builder.buildPerModuleDefaultPipeline(level).run(m, mam);
+      break;
+    case pipeline::pre_split:
+      builder.buildThinLTOPreLinkDefaultPipeline(level).run(m, mam);
+      break;
+    case pipeline::post_split:
+      builder.buildThinLTODefaultPipeline(level).run(m, mam);
+      break;
+  }
+}
+
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(std::string const& triple,
+                                                         std::string& message)
+{
+  static bool const initialized = [] {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+    return true;
+  }();
+  (void)initialized;
+
+  auto const* target = llvm::TargetRegistry::lookupTarget(triple, message);
+  if (!target)
+    return nullptr;
+
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      triple, "generic", "", llvm::TargetOptions{}, llvm::Reloc::PIC_));
+}
+
+bool emitFile(llvm::Module& m,
+              llvm::TargetMachine& machine,
+              std::string const& path,
+              bool assembly,
+              std::string& message)
+{
+  m.setTargetTriple(machine.getTargetTriple().str());
+  m.setDataLayout(machine.createDataLayout());
+
+  std::error_code ec;
+  llvm::raw_fd_ostream stream(path, ec, llvm::sys::fs::F_None);
+  if (ec) {
+    message = "Failed to open \"" + path + "\": " + ec.message();
+    return false;
+  }
+
+  llvm::legacy::PassManager pm;
+  if (machine.addPassesToEmitFile(pm, stream,
+                                  assembly ? llvm::TargetMachine::CGFT_AssemblyFile
+                                           : llvm::TargetMachine::CGFT_ObjectFile)) {
+    message = "The target machine cannot emit this type of file";
+    return false;
+  }
+  pm.run(m);
+  stream.flush();
+  return true;
+}
+
+// Where a call lands when the function behind a stub fails to compile. There is no code to
+// jump to, so the process cannot go on.
+void lazyCompileFailed()
+{
+  llvm::errs() << "Failed to compile a function on its first call\n";
+  std::abort();
+}
+
+// ORC stack that compiles each function only when it is first called, optimizing
+// it on its own at that point
+class lazy_jit
+{
+  using optimize_function_t =
+      std::function<std::shared_ptr<llvm::Module>(std::shared_ptr<llvm::Module>)>;
+
+  std::unique_ptr<llvm::TargetMachine> machine_;
+  llvm::DataLayout const data_layout_;
+  llvm::orc::RTDyldObjectLinkingLayer object_layer_;
+  llvm::orc::IRCompileLayer<decltype(object_layer_), llvm::orc::SimpleCompiler> compile_layer_;
+  llvm::orc::IRTransformLayer<decltype(compile_layer_), optimize_function_t> optimize_layer_;
+  std::unique_ptr<llvm::orc::JITCompileCallbackManager> callback_manager_;
+  llvm::orc::CompileOnDemandLayer<decltype(optimize_layer_)> cod_layer_;
+
+public:
+  lazy_jit(uint8_t optLevel, uint8_t sizeLevel)
+      : machine_(llvm::EngineBuilder().selectTarget()),
+        data_layout_(machine_->createDataLayout()),
+        object_layer_([] { return std::make_shared<llvm::SectionMemoryManager>(); }),
+        compile_layer_(object_layer_, llvm::orc::SimpleCompiler(*machine_)),
+        optimize_layer_(compile_layer_,
+                        [this, optLevel, sizeLevel](std::shared_ptr<llvm::Module> m) {
+                          runOptimizationPipeline(*m, optLevel, sizeLevel, machine_.get());
+                          return m;
+                        }),
+        callback_manager_(llvm::orc::createLocalCompileCallbackManager(
+            machine_->getTargetTriple(),
+            static_cast<llvm::JITTargetAddress>(reinterpret_cast<uintptr_t>(&lazyCompileFailed)))),
+        cod_layer_(optimize_layer_,
+                   [](llvm::Function& f) { return std::set<llvm::Function*>({&f}); },
+                   *callback_manager_,
+                   llvm::orc::createLocalIndirectStubsManagerBuilder(machine_->getTargetTriple()))
+  {
+  }
+
+  llvm::DataLayout const& getDataLayout() const { return data_layout_; }
+
+  void addModule(std::shared_ptr<llvm::Module> m)
+  {
+    auto resolver = llvm::orc::createLambdaResolver(
+        [this](std::string const& name) {
+          if (auto sym = cod_layer_.findSymbol(name, false))
+            return sym;
+          return llvm::JITSymbol(nullptr);
+        },
+        [](std::string const& name) {
+          if (auto addr = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name))
+            return llvm::JITSymbol(addr, llvm::JITSymbolFlags::Exported);
+          return llvm::JITSymbol(nullptr);
+        });
+    llvm::cantFail(cod_layer_.addModule(std::move(m), std::move(resolver)));
+  }
+
+  llvm::JITSymbol findSymbol(std::string const& name)
+  {
+    std::string mangled;
+    llvm::raw_string_ostream stream(mangled);
+    llvm::Mangler::getNameWithPrefix(stream, name, data_layout_);
+    return cod_layer_.findSymbol(stream.str(), true);
+  }
+};
+}  // namespace
+
 module::module(std::string const& name, std::string const& entry_function_name)
     : context_(new llvm::LLVMContext()),
       llvm_module_(new llvm::Module(name, *context_)),
@@ -57,6 +254,15 @@ module::module(std::string const& name, std::string const& entry_function_name)
 {
 }
 
+module::module(std::string const& name,
+               llvm::LLVMContext& context,
+               std::string const& entry_function_name)
+    : context_(&context),
+      llvm_module_(new llvm::Module(name, context)),
+      entry_function_name_(entry_function_name)
+{
+}
+
 module::~module()
 {
   delete llvm_module_;
@@ -85,26 +291,7 @@ std::string module::getEntryFunctionName() const
 
 void module::optimize(uint8_t optLevel, uint8_t sizeLevel)
 {
-  llvm::legacy::PassManager* pm          = new llvm::legacy::PassManager();
-  llvm::legacy::FunctionPassManager* fpm = new llvm::legacy::FunctionPassManager(llvm_module_);
-  llvm::PassManagerBuilder builder;
-  builder.OptLevel           = optLevel;
-  builder.SizeLevel          = sizeLevel;
-  builder.Inliner            = llvm::createFunctionInliningPass(optLevel, sizeLevel, true);
-  builder.DisableUnitAtATime = false;
-  builder.DisableUnrollLoops = false;
-  builder.LoopVectorize      = true;
-  builder.SLPVectorize       = true;
-  builder.populateModulePassManager(*pm);
-  builder.populateFunctionPassManager(*fpm);
-  pm->run(*llvm_module_);
-
-  fpm->doInitialization();
-  for (auto& f : llvm_module_->getFunctionList()) {
-    fpm->run(f);
-    f.optForSize();
-  }
-  fpm->doFinalization();
+  runOptimizationPipeline(*llvm_module_, optLevel, sizeLevel);
 }
 
 bool module::verify(error& err) const
@@ -118,6 +305,244 @@ bool module::verify(error& err) const
     return true;
 }
 
+void module::hideUnnamedFunctions()
+{
+  for (auto& f : *llvm_module_) {
+    if (!f.isDeclaration() && !f.hasName())
+      f.setLinkage(llvm::Function::InternalLinkage);
+  }
+}
+
+bool module::emit(std::string const& path, std::string const& triple, bool assembly, error& err)
+{
+  std::string message;
+  auto machine = createTargetMachine(triple, message);
+  if (!machine || !emitFile(*llvm_module_, *machine, path, assembly, message)) {
+    err = error(message, locationInfo{}, errorType::Internal);
+    return false;
+  }
+  return true;
+}
+
+bool module::emitSplit(std::string const& path,
+                       std::string const& triple,
+                       uint8_t optLevel,
+                       uint8_t sizeLevel,
+                       unsigned jobs,
+                       std::vector<std::string>& objects,
+                       error& err)
+{
+  std::string message;
+  auto machine = createTargetMachine(triple, message);
+  if (!machine) {
+    err = error(message, locationInfo{}, errorType::Internal);
+    return false;
+  }
+  llvm_module_->setTargetTriple(triple);
+  llvm_module_->setDataLayout(machine->createDataLayout());
+  runOptimizationPipeline(*llvm_module_, optLevel, sizeLevel, machine.get(), pipeline::pre_split);
+
+  // The partitioning depends on the module alone, so that the output does not depend on jobs
+  auto const defined = std::count_if(llvm_module_->begin(), llvm_module_->end(),
+                                     [](llvm::Function const& f) { return !f.isDeclaration(); });
+  auto const partitions = static_cast<unsigned>(
+      std::max<std::ptrdiff_t>(1, std::min(defined, max_partitions)));
+
+  // Contexts are not thread-safe, so every partition goes to its thread as bitcode
+  std::vector<std::string> bitcodes;
+  llvm::SplitModule(llvm::CloneModule(llvm_module_), partitions,
+                    [&bitcodes](std::unique_ptr<llvm::Module> part) {
+                      bitcodes.emplace_back();
+                      llvm::raw_string_ostream stream(bitcodes.back());
+                      llvm::WriteBitcodeToFile(part.get(), stream);
+                    });
+
+  // named before any task starts, as the tasks read objects while the loop below runs
+  objects.clear();
+  for (size_t i = 0; i < bitcodes.size(); i++)
+    objects.push_back(path + "." + std::to_string(i) + ".o");
+
+  std::vector<std::string> messages(bitcodes.size());
+  {
+    llvm::ThreadPool pool(std::max(jobs, 1u));
+    for (size_t i = 0; i < bitcodes.size(); i++) {
+      pool.async([&, i] {
+        llvm::LLVMContext context;
+        auto part = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(bitcodes[i], objects[i]), context);
+        if (!part) {
+          messages[i] = llvm::toString(part.takeError());
+          return;
+        }
+        auto partmachine = createTargetMachine(triple, messages[i]);
+        if (!partmachine)
+          return;
+        runOptimizationPipeline(**part, optLevel, sizeLevel, partmachine.get(),
+                                pipeline::post_split);
+        emitFile(**part, *partmachine, objects[i], false, messages[i]);
+      });
+    }
+    pool.wait();
+  }
+
+  for (auto const& m : messages) {
+    if (!m.empty()) {
+      err = error(m, locationInfo{}, errorType::Internal);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool module::prepareJIT(error& err)
+{
+  static bool const initialized = [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    return true;
+  }();
+  (void)initialized;
+
+  // @import#c and GC_* are resolved from the host process and the libraries it would be linked to
+  std::string message;
+  if (llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr, &message)) {
+    err = error(message, locationInfo{}, errorType::Internal);
+    return false;
+  }
+  for (auto const& lib : link_libraries_) {
+    if (!loadLinkLibrary(lib, message)) {
+      err = error(message, locationInfo{}, errorType::Internal);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool module::run(std::vector<std::string> const& args,
+                 int& status,
+                 error& err,
+                 object_cache* cache)
+{
+  auto* entry = llvm_module_->getFunction(entry_function_name_);
+  if (!entry) {
+    err = error("Entry function \"" + entry_function_name_ + "\" is not defined", locationInfo{},
+                errorType::Internal);
+    return false;
+  }
+  if (!prepareJIT(err))
+    return false;
+
+  std::string message;
+  std::unique_ptr<llvm::ExecutionEngine> engine(
+      llvm::EngineBuilder(std::unique_ptr<llvm::Module>(llvm_module_))
+          .setEngineKind(llvm::EngineKind::JIT)
+          .setErrorStr(&message)
+          .setMCJITMemoryManager(std::make_unique<llvm::SectionMemoryManager>())
+          .create());
+  if (!engine) {
+    // EngineBuilder destroys the module it failed to take
+    llvm_module_ = nullptr;
+    err          = error(message, locationInfo{}, errorType::Internal);
+    return false;
+  }
+
+  if (cache) {
+    cache->record(*this);
+    engine->setObjectCache(cache);
+  }
+
+  engine->finalizeObject();
+  status = engine->runFunctionAsMain(entry, args, nullptr);
+  engine->removeModule(llvm_module_);  // ownership returns to this module
+  return true;
+}
+
+bool module::runCached(object_cache& cache,
+                       std::vector<std::string> const& args,
+                       int& status,
+                       error& err)
+{
+  link_libraries_ = cache.getLinkLibraries();
+  if (!prepareJIT(err))
+    return false;
+
+  auto buffer = cache.takeObject();
+  auto object = llvm::object::ObjectFile::createObjectFile(buffer->getMemBufferRef());
+  if (!object) {
+    err = error(llvm::toString(object.takeError()), locationInfo{}, errorType::Internal);
+    return false;
+  }
+
+  std::string message;
+  std::unique_ptr<llvm::ExecutionEngine> engine(
+      llvm::EngineBuilder(std::unique_ptr<llvm::Module>(llvm_module_))
+          .setEngineKind(llvm::EngineKind::JIT)
+          .setErrorStr(&message)
+          .setMCJITMemoryManager(std::make_unique<llvm::SectionMemoryManager>())
+          .create());
+  if (!engine) {
+    llvm_module_ = nullptr;
+    err          = error(message, locationInfo{}, errorType::Internal);
+    return false;
+  }
+  engine->removeModule(llvm_module_);  // only the cached object is executed
+  engine->addObjectFile(
+      llvm::object::OwningBinary<llvm::object::ObjectFile>(std::move(*object), std::move(buffer)));
+  engine->finalizeObject();
+
+  auto entry = reinterpret_cast<int (*)(int, char**)>(
+      static_cast<uintptr_t>(engine->getFunctionAddress(entry_function_name_)));
+  if (!entry) {
+    err = error("Entry function \"" + entry_function_name_ + "\" is not in the cached object",
+                locationInfo{}, errorType::Internal);
+    return false;
+  }
+
+  std::vector<char*> argv;
+  for (auto const& a : args)
+    argv.push_back(const_cast<char*>(a.c_str()));
+  argv.push_back(nullptr);
+  status = entry(static_cast<int>(args.size()), argv.data());
+  return true;
+}
+
+bool module::runLazily(std::vector<std::string> const& args,
+                       uint8_t optLevel,
+                       uint8_t sizeLevel,
+                       int& status,
+                       error& err)
+{
+  if (!prepareJIT(err))
+    return false;
+
+  // partitions refer to each other by symbol name, so anonymous functions need one
+  for (auto& gv : llvm_module_->global_values()) {
+    if (!gv.hasName())
+      gv.setName("__scopion_anon");
+  }
+
+  lazy_jit jit(optLevel, sizeLevel);
+  llvm_module_->setDataLayout(jit.getDataLayout());
+  // the jit never outlives this module, so it only borrows llvm_module_
+  jit.addModule(std::shared_ptr<llvm::Module>(llvm_module_, [](llvm::Module*) {}));
+
+  auto sym = jit.findSymbol(entry_function_name_);
+  if (!sym) {
+    err = error("Entry function \"" + entry_function_name_ + "\" cannot be resolved",
+                locationInfo{}, errorType::Internal);
+    return false;
+  }
+  auto entry = reinterpret_cast<int (*)(int, char**)>(
+      static_cast<uintptr_t>(llvm::cantFail(sym.getAddress())));
+
+  std::vector<char*> argv;
+  for (auto const& a : args)
+    argv.push_back(const_cast<char*>(a.c_str()));
+  argv.push_back(nullptr);
+  status = entry(static_cast<int>(args.size()), argv.data());
+  return true;
+}
+
 llvm::LLVMContext& module::getContext() const
 {
   return llvm_module_->getContext();
@@ -128,6 +553,13 @@ llvm::Module* module::getLLVMModule() const
   return llvm_module_;
 }
 
+std::unique_ptr<llvm::Module> module::releaseLLVMModule()
+{
+  auto m       = llvm_module_;
+  llvm_module_ = nullptr;
+  return std::unique_ptr<llvm::Module>(m);
+}
+
 std::string module::generateLinkerFlags()
 {
   std::sort(link_libraries_.begin(), link_libraries_.end());
@@ -138,5 +570,15 @@ std::string module::generateLinkerFlags()
   ;
 }
 
+bool loadLinkLibrary(std::string const& name, std::string& message)
+{
+#ifdef __APPLE__
+  auto const filename = "lib" + name + ".dylib";
+#else
+  auto const filename = "lib" + name + ".so";
+#endif
+  return !llvm::sys::DynamicLibrary::LoadLibraryPermanently(filename.c_str(), &message);
+}
+
 }  // namespace assembly
 }  // namespace scopion
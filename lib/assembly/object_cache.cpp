@@ -0,0 +1,138 @@
+/**
+* @file object_cache.cpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scopion/assembly/object_cache.hpp"
+#include "scopion/assembly/module.hpp"
+
+#include "scopion/config.hpp"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/MD5.h>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace scopion
+{
+namespace assembly
+{
+static std::string readFile(boost::filesystem::path const& path)
+{
+  std::ifstream ifs(path.string(), std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+object_cache::object_cache(std::string const& key) : dir_(directory() / "objects" / key) {}
+
+boost::filesystem::path object_cache::directory()
+{
+  if (auto const home = std::getenv("HOME"))
+    return boost::filesystem::path(home) / SCOPION_CACHE_DIR;
+  boost::system::error_code ec;
+  return boost::filesystem::temp_directory_path(ec) / SCOPION_CACHE_DIR;
+}
+
+std::string object_cache::hash(std::vector<std::string> const& parts)
+{
+  llvm::MD5 md5;
+  for (auto const& p : parts) {
+    md5.update(std::to_string(p.size()));  // keeps ("ab", "c") apart from ("a", "bc")
+    md5.update(p);
+  }
+  llvm::MD5::MD5Result result;
+  md5.final(result);
+  llvm::SmallString<32> str;
+  llvm::MD5::stringifyResult(result, str);
+  return std::string(str.begin(), str.end());
+}
+
+bool object_cache::load()
+{
+  std::ifstream deps((dir_ / "deps").string());
+  std::ifstream libs((dir_ / "libs").string());
+  if (deps.fail() || libs.fail())
+    return false;
+
+  std::string digest, path;
+  while (deps >> digest && std::getline(deps >> std::ws, path)) {
+    if (hash({readFile(path)}) != digest)
+      return false;
+  }
+  link_libraries_.assign(std::istream_iterator<std::string>(libs),
+                         std::istream_iterator<std::string>());
+
+  auto buf = llvm::MemoryBuffer::getFile((dir_ / "object").string());
+  if (!buf)
+    return false;
+  object_ = std::move(*buf);
+  return true;
+}
+
+void object_cache::record(module const& mod)
+{
+  dependencies_   = mod.getDependencies();
+  link_libraries_ = mod.getLinkLibraries();
+}
+
+void object_cache::notifyObjectCompiled(llvm::Module const*, llvm::MemoryBufferRef obj)
+{
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(dir_, ec);
+  if (ec)
+    return;  // caching is best-effort
+
+  // load() ignores the entry while its object is missing, so an older object must not be paired
+  // with the new deps and libs
+  boost::filesystem::remove(dir_ / "object", ec);
+
+  {
+    std::ofstream deps((dir_ / "deps.tmp").string());
+    for (auto const& d : dependencies_)
+      deps << hash({readFile(d)}) << ' ' << d << '\n';
+    std::ofstream libs((dir_ / "libs.tmp").string());
+    for (auto const& l : link_libraries_)
+      libs << l << '\n';
+    std::ofstream object((dir_ / "object.tmp").string(), std::ios::binary);
+    object.write(obj.getBufferStart(), static_cast<std::streamsize>(obj.getBufferSize()));
+    if (!deps.flush() || !libs.flush() || !object.flush())
+      return;
+  }
+  // each file is complete once renamed, and the object comes last as it makes the entry visible
+  for (auto const name : {"deps", "libs", "object"}) {
+    boost::filesystem::rename(dir_ / (std::string(name) + ".tmp"), dir_ / name, ec);
+    if (ec)
+      return;
+  }
+}
+
+std::unique_ptr<llvm::MemoryBuffer> object_cache::getObject(llvm::Module const*)
+{
+  if (!object_)
+    return nullptr;
+  return llvm::MemoryBuffer::getMemBufferCopy(object_->getBuffer());
+}
+
+}  // namespace assembly
+}  // namespace scopion
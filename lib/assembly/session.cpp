@@ -0,0 +1,172 @@
+/**
+* @file session.cpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scopion/assembly/session.hpp"
+#include "scopion/assembly/module.hpp"
+
+#include "scopion/parser/parser.hpp"
+
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <sstream>
+
+namespace scopion
+{
+namespace assembly
+{
+session::session(std::vector<std::string> const& flags)
+{
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  std::string message;
+  if (llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr, &message))
+    throw error(message, locationInfo{}, errorType::Internal);
+
+  engine_.reset(llvm::EngineBuilder(std::make_unique<llvm::Module>("__repl", context_))
+                    .setEngineKind(llvm::EngineKind::JIT)
+                    .setErrorStr(&message)
+                    .setMCJITMemoryManager(std::make_unique<llvm::SectionMemoryManager>())
+                    .create());
+  if (!engine_)
+    throw error(message, locationInfo{}, errorType::Internal);
+
+  auto trflags = flags;
+  trflags.push_back("repl");
+  llvm::IRBuilder<> builder(context_);
+  auto first = std::make_unique<module>(moduleName(), context_);
+  current_   = first.get();
+  translator_ =
+      std::make_unique<translator>(std::move(first), builder, std::make_shared<region>(), trflags);
+  root_ = translator_->getScope();
+}
+
+session::~session() = default;
+
+void session::loadLibrary(std::string const& lib)
+{
+  if (!loaded_libraries_.insert(lib).second)
+    return;
+
+  std::string message;
+  if (!loadLinkLibrary(lib, message))
+    throw error(message, locationInfo{}, errorType::Internal);
+  if (lib == "gc") {
+    if (auto init = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol("GC_init"))
+      reinterpret_cast<void (*)()>(init)();
+  }
+}
+
+bool session::eval(std::string const& code, std::string& result, error& err)
+{
+  result.clear();
+  auto ast = parser::parse(code, err);
+  if (!ast)
+    return false;
+
+  auto const name = moduleName();
+  auto* llmod     = current_->getLLVMModule();
+  auto& builder   = translator_->getBuilder();
+  auto* func      = llvm::Function::Create(llvm::FunctionType::get(builder.getVoidTy(), false),
+                                      llvm::Function::ExternalLinkage, name, llmod);
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context_, "entry", func));
+
+  auto const saved = root_->symbols();
+  auto* v          = translator_->translateAST(*ast, err);
+
+  llvm::GlobalVariable* resultv = nullptr;
+  if (v) {
+    auto* rv = v->getLLVM();
+    if (!v->getType()->isLazy() && rv &&
+        (rv->getType()->isIntegerTy() || rv->getType()->isDoubleTy())) {
+      resultv = new llvm::GlobalVariable(*llmod, rv->getType(), false,
+                                         llvm::GlobalValue::ExternalLinkage,
+                                         llvm::Constant::getNullValue(rv->getType()),
+                                         name + "_result");
+      builder.CreateStore(rv, resultv);
+    }
+    builder.CreateRetVoid();
+
+    // Unnamed globals would collide with the ones of other pieces in the JIT
+    for (auto& gv : llmod->global_values()) {
+      if (!gv.hasName())
+        gv.setName(name + "_anon");
+    }
+
+    std::string message;
+    llvm::raw_string_ostream stream(message);
+    if (llvm::verifyModule(*llmod, &stream)) {
+      err = error("Invalid IR has generated: " + stream.str(), locationInfo{}, errorType::Bug);
+      v   = nullptr;
+    }
+  }
+
+  // Whatever happened, the next piece goes into a fresh module
+  if (!v) {
+    translator_->setScope(root_);
+    root_->symbols() = saved;
+  }
+  ++count_;
+  auto next = std::make_unique<module>(moduleName(), context_);
+  current_  = next.get();
+  auto done = translator_->swapModule(std::move(next));
+  if (!v)
+    return false;
+
+  try {
+    for (auto const& lib : done->getLinkLibraries())
+      loadLibrary(lib);
+  } catch (error& e) {
+    err = e;
+    return false;
+  }
+
+  engine_->addModule(done->releaseLLVMModule());
+  engine_->finalizeObject();
+  reinterpret_cast<void (*)()>(engine_->getFunctionAddress(name))();
+
+  if (resultv) {
+    auto addr = engine_->getGlobalValueAddress(name + "_result");
+    auto* ty  = resultv->getValueType();
+    std::ostringstream out;
+    if (ty->isDoubleTy())
+      out << *reinterpret_cast<double*>(addr);
+    else if (ty->isIntegerTy(1))
+      out << (*reinterpret_cast<bool*>(addr) ? "true" : "false");
+    else if (ty->isIntegerTy(64))
+      out << *reinterpret_cast<int64_t*>(addr);
+    else if (ty->isIntegerTy(32))
+      out << *reinterpret_cast<int32_t*>(addr);
+    else if (ty->isIntegerTy(8))
+      out << static_cast<int>(*reinterpret_cast<int8_t*>(addr));
+    result = out.str();
+  }
+  return true;
+}
+
+}  // namespace assembly
+}  // namespace scopion
@@ -20,23 +20,31 @@
 */
 
 #include "scopion/assembly/translator.hpp"
+#include "scopion/assembly/cheader.hpp"
+#include "scopion/assembly/object_cache.hpp"
 #include "scopion/assembly/value.hpp"
 #include "scopion/parser/parser.hpp"
 
 #include "scopion/config.hpp"
 #include "scopion/error.hpp"
+#include "scopion/profiler.hpp"
 
 #include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/Constants.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_os_ostream.h>
 
 #include <algorithm>
+#include <cctype>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <memory>
+#include <sstream>
 #include <string>
 
 #include <boost/range/adaptor/indexed.hpp>
@@ -53,28 +61,40 @@ translator::translator()
     : boost::static_visitor<value*>(),
       module_(std::make_unique<module>("notafile")),
       builder_(module_->getContext()),
-      thisScope_(new value())
+      imports_(std::make_shared<import_cache>()),
+      region_(std::make_shared<region>()),
+      thisScope_(region_->makeValue()),
+      rootScope_(thisScope_)
 {
 }
 
 translator::translator(boost::filesystem::path const& name,
                        std::vector<std::string> const& flags,
-                       std::string const& efname)
+                       std::string const& efname,
+                       std::shared_ptr<import_cache> imports)
     : boost::static_visitor<value*>(),
       module_(std::make_unique<module>(name.filename().string(), efname)),
       builder_(module_->getContext()),
-      thisScope_(new value()),
+      imports_(imports ? std::move(imports) : std::make_shared<import_cache>()),
+      region_(std::make_shared<region>()),
+      thisScope_(region_->makeValue()),
+      rootScope_(thisScope_),
       flags_(flags)
 {
 }
 
 translator::translator(std::unique_ptr<module>&& module,
                        llvm::IRBuilder<>& builder,
-                       std::vector<std::string> const& flags)
+                       std::shared_ptr<region> rg,
+                       std::vector<std::string> const& flags,
+                       std::shared_ptr<import_cache> imports)
     : boost::static_visitor<value*>(),
       module_(std::move(module)),
       builder_(builder),
-      thisScope_(new value()),
+      imports_(imports ? std::move(imports) : std::make_shared<import_cache>()),
+      region_(std::move(rg)),
+      thisScope_(region_->makeValue()),
+      rootScope_(thisScope_),
       flags_(flags)
 {
 }
@@ -100,13 +120,70 @@ value* translator::translateAST(ast::expr const& ast, error& err)
   }
 }
 
+value* translator::translateAsLval(ast::expr const& node)
+{
+  auto prev    = lval_target_;
+  lval_target_ = &ast::attr(node);
+  try {
+    auto v       = boost::apply_visitor(*this, node);
+    lval_target_ = prev;
+    return v;
+  } catch (...) {
+    lval_target_ = prev;
+    throw;
+  }
+}
+
+// The counterpart of v in m, or nullptr if v is local to a function of another module
+static llvm::Value* redeclare(llvm::Value* v, llvm::Module* m)
+{
+  if (auto* gv = llvm::dyn_cast<llvm::GlobalVariable>(v))
+    return m->getOrInsertGlobal(gv->getName(), gv->getValueType());
+  if (auto* f = llvm::dyn_cast<llvm::Function>(v))  // lazy ones belong to no module
+    return f->getParent() ? m->getOrInsertFunction(f->getName(), f->getFunctionType()) : f;
+  if (llvm::isa<llvm::ConstantData>(v) || llvm::isa<llvm::BasicBlock>(v))
+    return v;
+  return nullptr;
+}
+
+std::unique_ptr<module> translator::swapModule(std::unique_ptr<module>&& next)
+{
+  next->struct_types_ = module_->struct_types_;
+  specializations_.clear();  // they are defined in the module being handed off
+
+  std::vector<std::pair<std::string, value*>> moved;
+  for (auto const& s : rootScope_->symbols()) {
+    if (auto* v = s.second->getLLVM()) {
+      auto* nv = redeclare(v, next->getLLVMModule());
+      moved.emplace_back(s.first, nv ? s.second->copyWithNewLLVMValue(nv) : nullptr);
+    }
+  }
+  for (auto const& m : moved) {
+    if (m.second)
+      rootScope_->symbols()[m.first] = m.second;
+    else
+      rootScope_->symbols().erase(m.first);
+  }
+
+  std::swap(module_, next);
+  return std::move(next);
+}
+
+llvm::StructType* translator::getStructType(std::vector<llvm::Type*> const& fields,
+                                            std::string const& name)
+{
+  auto& st = module_->struct_types_[fields];
+  if (!st)
+    st = llvm::StructType::create(module_->getContext(), fields, name);
+  return st;
+}
+
 llvm::Value* translator::createMainRet(value* val, error& err)
 {
   auto* mainf = module_->getLLVMModule()->getFunction(module_->getEntryFunctionName());
   assert(mainf && "main cannot be found in the module");
 
-  auto where = ast::apply<locationInfo>([](auto& x) -> locationInfo { return ast::attr(x).where; },
-                                        val->getAst());
+  auto where = ast::attr(val->getAst()).where;
   if (!llvm::isa<llvm::Function>(val->getLLVM())) {
     err = error("Top-level value must be function", where, errorType::Translate);
     return nullptr;
@@ -128,7 +205,7 @@ llvm::Value* translator::createMainRet(value* val, error& err)
       if (!llvm::cast<llvm::Function>(val->getLLVM())->arg_empty()) {
         for (auto it = mainf->arg_begin(); it != mainf->arg_end(); it++) {
           arg_llvm_values.push_back(it);
-          arg_values.push_back(new value(it, ast::expr{}));
+          arg_values.push_back(region_->makeValue(it, ast::expr{}));
         }
       }
       llval = evaluate(val, arg_values, *this)->getLLVM();
@@ -160,108 +237,295 @@ bool translator::hasFlag(std::string const& key)
   return std::find(flags_.cbegin(), flags_.cend(), key) != flags_.cend();
 }
 
+// Whether v can be used from any function: lazy values other than scopes, which are blocks of
+// the function they are written in
+static bool isCompileTimeValue(value const* v)
+{
+  return v->getType()->isLazy() && !v->getType()->getLLVM()->isLabelTy();
+}
+
+// Makes to use the compile-time members of an earlier translation of the same module, so that
+// the functions they hold are specialized once
+static void shareLazyMembers(value const* from, value* to)
+{
+  for (auto const& s : from->symbols()) {
+    auto const it = to->symbols().find(s.first);
+    if (it == to->symbols().end())
+      continue;
+    if (isCompileTimeValue(s.second))
+      to->symbols()[s.first] = s.second;
+    else
+      shareLazyMembers(s.second, it->second);
+  }
+}
+
+// Whether fcv is compiled where it is written: every parameter has a type and it isn't lazy
+static bool hasSignature(ast::function const& fcv)
+{
+  auto const& args = ast::val(fcv).first;
+  return std::all_of(args.begin(), args.end(),
+                     [](auto& x) {
+                       return ast::attr(x).attributes.find("type") !=
+                              ast::attr(x).attributes.end();
+                     }) &&
+         ast::attr(fcv).attributes.find("lazy") == ast::attr(fcv).attributes.end();
+}
+
 value* translator::import(std::string const& path, ast::pre_variable const& astv)
 {
   auto thisp   = ast::attr(astv).where.getPath();
   auto abspath = boost::filesystem::absolute(
       path, thisp ? thisp->parent_path() : boost::filesystem::current_path());
-  std::ifstream ifs(abspath.string());
-  if (ifs.fail()) {
+  boost::system::error_code ec;
+  auto const canonical = boost::filesystem::canonical(abspath, ec);
+  if (ec)
     return nullptr;
+  auto const key = canonical.string();
+  profileScope timing("import", key);
+  module_->dependencies_.push_back(key);
+
+  // The module is parsed once per compilation. A value which exists only at compile time is
+  // shared; one with runtime data is translated again, as every import makes its own instance.
+  auto const imported = region_->findImportedModule(key);
+  if (imported && isCompileTimeValue(imported->val))
+    return instantiate(imported->val->copy());
+
+  boost::optional<ast::expr> parsed;
+  declaration_table const* definitions = nullptr;
+  if (imported) {
+    parsed      = imported->ast;
+    definitions = imported->definitions;
+  } else {
+    auto code = imports_->getFile(key);
+    if (!code)
+      return nullptr;
+    error err;
+    if (canonical.extension() == interface_extension)
+      parsed = readInterface(*code, canonical, definitions, err);
+    else
+      parsed = parser::parse(*code, err, canonical);
+    if (!parsed)
+      throw err;
+  }
+
+  // an interface refers to the functions compiled into the module's object by their names
+  if (definitions) {
+    for (auto const& d : *definitions)
+      declareFunction(d.first, d.second);
   }
-  std::string code((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-  ifs.close();
-  error err;
-  auto parsed = parser::parse(code, err, abspath);
-  if (!parsed)
-    throw err;
-  translator tr(std::move(module_), builder_);
+
+  // Functions with a signature are not compiled until the importer refers to them
+  translator tr(std::move(module_), builder_, region_, std::vector<std::string>{"defer-functions"},
+                imports_);
   auto val = boost::apply_visitor(tr, *parsed);
   module_  = tr.takeModule();
-  return val;
+
+  if (imported)
+    shareLazyMembers(imported->val, val);
+  else
+    region_->addImportedModule(key, {*parsed, val, definitions});
+  return instantiate(val);
 }
 
-value* translator::importIR(std::string const& path, ast::pre_variable const& astv)
+// The first line of an interface file; one of another version is not read
+static std::string const interface_header = "; scopion interface " SCOPION_VERSION;
+
+// Turns s into characters of an identifier, escaping all but letters and digits
+static std::string mangle(std::string const& s)
 {
-  std::unique_ptr<llvm::Module> module;
-  if (loaded_map_.count(path) != 0) {
-    module = std::move(loaded_map_[path]);
-  } else {
-    llvm::SMDiagnostic err;
-    module = llvm::parseIRFile(path, err, module_->getContext());
-    if (!module) {
-      llvm::raw_os_ostream stream(std::cerr);
-      err.print(path.c_str(), stream);
-      return nullptr;
-    }
+  std::ostringstream ss;
+  ss << std::hex << std::setfill('0');
+  for (unsigned char c : s) {
+    if (std::isalnum(c))
+      ss << c;
+    else
+      ss << '_' << std::setw(2) << static_cast<int>(c);
   }
-  auto destv = new value(nullptr, astv);
+  return ss.str();
+}
 
-  std::vector<llvm::Type*> fields;
-  uint32_t cnt = 0;
-  for (auto i = module->getFunctionList().begin(); i != module->getFunctionList().end(); ++i) {
-    // FIXME: find better way to avoid link error (zopen causes link error)
-    if (!i->getName().startswith("llvm.")) {
-      llvm::Function* func;
-      if (!(func = module_->getLLVMModule()->getFunction(i->getName())))
-        func = llvm::Function::Create(i->getFunctionType(), llvm::Function::ExternalLinkage,
-                                      i->getName(), module_->getLLVMModule());
-      auto vp                              = new value(func, astv);
-      destv->symbols()[i->getName().str()] = vp;
-      destv->fields()[i->getName().str()]  = cnt;
-      cnt++;
-      vp->setParent(destv);
-      fields.push_back(i->getType());
+bool translator::exportModule(ast::expr const& tree, std::string& interface, error& err)
+{
+  if (!ast::isa<ast::structure>(tree)) {
+    err = error("Only a structure can be compiled as a module", ast::attr(tree).where,
+                errorType::Translate);
+    return false;
+  }
+
+  // The symbols are named after the module's path, as modules in different directories may have
+  // the same name
+  auto const& id = module_->getLLVMModule()->getModuleIdentifier();
+  auto path      = ast::attr(tree).where.getPath().value_or(id);
+  boost::system::error_code ec;
+  auto const canonical = boost::filesystem::canonical(path, ec);
+  if (!ec)
+    path = canonical;
+  auto const prefix = "scopion_" + mangle(path.stem().string()) + "_" +
+                      object_cache::hash({path.string()}).substr(0, 8) + "_";
+  llvm::Module declarations(id, module_->getContext());
+
+  // Functions are compiled where they are written; here, in a function thrown away afterwards
+  auto holder = llvm::Function::Create(llvm::FunctionType::get(builder_.getVoidTy(), false),
+                                       llvm::Function::InternalLinkage, "",
+                                       module_->getLLVMModule());
+  builder_.SetInsertPoint(llvm::BasicBlock::Create(module_->getContext(), "entry", holder));
+
+  std::string source = "[";
+  try {
+    for (auto const& m : ast::val(ast::unpack<ast::structure>(tree))) {
+      if (source.size() > 1)
+        source += ", ";
+      source += ast::val(m.first) + ": ";
+      if (ast::isa<ast::function>(m.second) &&
+          hasSignature(ast::unpack<ast::function>(m.second))) {
+        auto func = llvm::cast<llvm::Function>(boost::apply_visitor(*this, m.second)->getLLVM());
+        if (!func->hasName())  // not named with #export
+          func->setName(prefix + mangle(ast::val(m.first)));
+        llvm::Function::Create(func->getFunctionType(), llvm::Function::ExternalLinkage,
+                               func->getName(), &declarations);
+        source += "@" + func->getName().str();
+      } else {  // translated by the importer, which specializes lazy functions for its arguments
+        source += ast::toSource(m.second);
+      }
     }
+  } catch (error& e) {
+    holder->eraseFromParent();
+    builder_.ClearInsertionPoint();
+    err = e;
+    return false;
   }
+  holder->eraseFromParent();
+  builder_.ClearInsertionPoint();
+  source += "]";
+
+  std::string libraries;
+  for (auto const& l : module_->link_libraries_)
+    libraries += " " + l;
+
+  std::string ir;
+  llvm::raw_string_ostream stream(ir);
+  declarations.print(stream, nullptr);
+  interface = interface_header + "\n; " + source + "\n;" + libraries + "\n" + stream.str();
+  return true;
+}
 
-  llvm::StructType* structTy = llvm::StructType::create(module_->getContext());
-  structTy->setBody(fields);
-  structTy->setName("cheader_type");
+boost::optional<ast::expr> translator::readInterface(std::string const& code,
+                                                     boost::filesystem::path const& path,
+                                                     declaration_table const*& definitions,
+                                                     error& err)
+{
+  std::istringstream lines(code);
+  std::string header, source, libraries;
+  std::getline(lines, header);
+  std::getline(lines, source);
+  std::getline(lines, libraries);
+  if (header != interface_header || source.compare(0, 2, "; ") != 0 ||
+      libraries.compare(0, 1, ";") != 0) {
+    err = error("\"" + path.string() + "\" is not an interface of this version of scopion",
+                locationInfo{}, errorType::Translate);
+    return boost::none;
+  }
 
-  for (auto t : module_->getLLVMModule()->getIdentifiedStructTypes()) {
-    if (structTy->isLayoutIdentical(t)) {
-      structTy = t;
-      break;
-    }
+  llvm::SMDiagnostic diag;
+  auto declarations =
+      llvm::parseIR(llvm::MemoryBufferRef(code, path.string()), diag, module_->getContext());
+  if (!declarations) {
+    llvm::raw_os_ostream stream(std::cerr);
+    diag.print(path.c_str(), stream);
+    err = error("Failed to read the declarations in \"" + path.string() + "\"", locationInfo{},
+                errorType::Translate);
+    return boost::none;
   }
+  auto table = region_->makeDeclarationTable();
+  for (auto const& f : *declarations)
+    (*table)[f.getName().str()] = f.getFunctionType();
+  definitions = table;
 
-  auto ptr = builder_.CreateAlloca(structTy);
-  destv->setLLVM(ptr);
+  std::istringstream libs(libraries.substr(1));
+  module_->link_libraries_.insert(module_->link_libraries_.end(),
+                                  std::istream_iterator<std::string>(libs),
+                                  std::istream_iterator<std::string>());
+
+  return parser::parse(source.substr(2), err, path);
+}
+
+llvm::Function* translator::declareFunction(std::string const& name, llvm::FunctionType* type)
+{
+  if (auto func = module_->getLLVMModule()->getFunction(name))
+    return func;
+  return llvm::Function::Create(type, llvm::Function::ExternalLinkage, name,
+                                module_->getLLVMModule());
+}
 
-  for (auto const& x : destv->fields()) {
-    auto p = builder_.CreateStructGEP(structTy, ptr, x.second);
-    builder_.CreateStore(destv->symbols()[x.first]->getLLVM(), p);
-    destv->symbols()[x.first]->setLLVM(p);
+value* translator::importIR(std::string const& path, ast::pre_variable const& astv)
+{
+  return importIR(path, imports_->getFile(path), astv);
+}
+
+value* translator::importIR(std::string const& path,
+                            std::shared_ptr<std::string const> const& ir,
+                            ast::pre_variable const& astv)
+{
+  auto const cached = loaded_map_.find(path);
+  if (cached != loaded_map_.end()) {
+    auto destv = region_->makeValue(cached->second->getLLVM(), astv, true);  // is_lazy = true
+    destv->setDeclarations(cached->second->getDeclarations());
+    return destv;
   }
 
-  loaded_map_[path] = std::move(module);
+  llvm::SMDiagnostic err;
+  std::unique_ptr<llvm::Module> module;
+  if (ir)
+    module = llvm::parseIR(llvm::MemoryBufferRef(*ir, path), err, module_->getContext());
+  else
+    err = llvm::SMDiagnostic(path, llvm::SourceMgr::DK_Error, "Could not open the file");
+  if (!module) {
+    llvm::raw_os_ostream stream(std::cerr);
+    err.print(path.c_str(), stream);
+    return nullptr;
+  }
+  module_->dependencies_.push_back(path);
+
+  // Only the signatures are kept; the types belong to the context and outlive the parsed module
+  auto declarations = region_->makeDeclarationTable();
+  for (auto const& f : *module) {
+    if (!f.getName().startswith("llvm."))
+      (*declarations)[f.getName().str()] = f.getFunctionType();
+  }
+
+  // The namespace exists only at compile time. Its value is a null pointer of a type of its own,
+  // so that specializations taking different namespaces are told apart.
+  auto tag   = llvm::StructType::create(module_->getContext(), {}, "namespace");
+  auto destv = region_->makeValue(llvm::ConstantPointerNull::get(tag->getPointerTo()), astv,
+                                  true);  // is_lazy = true
+  destv->setDeclarations(declarations);
+
+  loaded_map_[path] = destv;
 
   return destv;
 }
 
 value* translator::importCHeader(std::string const& path, ast::pre_variable const& astv)
 {
-  auto const h2irpath = std::string(std::getenv("HOME")) + "/" SCOPION_CACHE_DIR "/h2ir/";
-  auto const cwd      = boost::filesystem::current_path();
-  system((std::string("bash " SCOPION_ETC_DIR "/h2ir/scopion-h2ir ") + path + ' ' + cwd.string())
-             .c_str());
-  return importIR(h2irpath + path, astv);
+  profileScope timing("import", path);
+  std::vector<std::string> const include_dirs = {boost::filesystem::current_path().string()};
+  return importIR(getCHeaderCachePath(path, include_dirs),
+                  imports_->getCHeaderIR(path, include_dirs), astv);
 }
 
-value* translator::operator()(ast::value astv)
+value* translator::operator()(ast::value const& astv)
 {
   return boost::apply_visitor(*this, astv);
 }
 
-value* translator::operator()(ast::operators astv)
+value* translator::operator()(ast::operators const& astv)
 {
   return boost::apply_visitor(*this, astv);
 }
 
-value* translator::operator()(ast::integer astv)
+value* translator::operator()(ast::integer const& astv)
 {
-  if (ast::attr(astv).lval)
+  if (isLval(astv))
     throw error("An integer constant is not to be assigned", ast::attr(astv).where,
                 errorType::Translate);
 
@@ -269,12 +533,13 @@ value* translator::operator()(ast::integer astv)
     throw error("An integer constant is not to be called", ast::attr(astv).where,
                 errorType::Translate);
 
-  return new value(llvm::ConstantInt::getSigned(builder_.getInt32Ty(), ast::val(astv)), astv);
+  return region_->makeValue(llvm::ConstantInt::getSigned(builder_.getInt32Ty(), ast::val(astv)),
+                            astv);
 }
 
-value* translator::operator()(ast::decimal astv)
+value* translator::operator()(ast::decimal const& astv)
 {
-  if (ast::attr(astv).lval)
+  if (isLval(astv))
     throw error("An integer constant is not to be assigned", ast::attr(astv).where,
                 errorType::Translate);
 
@@ -282,12 +547,12 @@ value* translator::operator()(ast::decimal astv)
     throw error("An integer constant is not to be called", ast::attr(astv).where,
                 errorType::Translate);
 
-  return new value(llvm::ConstantFP::get(builder_.getDoubleTy(), ast::val(astv)), astv);
+  return region_->makeValue(llvm::ConstantFP::get(builder_.getDoubleTy(), ast::val(astv)), astv);
 }
 
-value* translator::operator()(ast::boolean astv)
+value* translator::operator()(ast::boolean const& astv)
 {
-  if (ast::attr(astv).lval)
+  if (isLval(astv))
     throw error("A boolean constant is not to be assigned", ast::attr(astv).where,
                 errorType::Translate);
 
@@ -295,12 +560,12 @@ value* translator::operator()(ast::boolean astv)
     throw error("A boolean constant is not to be called", ast::attr(astv).where,
                 errorType::Translate);
 
-  return new value(llvm::ConstantInt::get(builder_.getInt1Ty(), ast::val(astv)), astv);
+  return region_->makeValue(llvm::ConstantInt::get(builder_.getInt1Ty(), ast::val(astv)), astv);
 }
 
 value* translator::operator()(ast::string const& astv)
 {
-  if (ast::attr(astv).lval)
+  if (isLval(astv))
     throw error("A string constant is not to be assigned", ast::attr(astv).where,
                 errorType::Translate);
 
@@ -308,18 +573,18 @@ value* translator::operator()(ast::string const& astv)
     throw error("A string constant is not to be called", ast::attr(astv).where,
                 errorType::Translate);
 
-  return new value(builder_.CreateGlobalStringPtr(ast::val(astv)), astv);
+  return region_->makeValue(builder_.CreateGlobalStringPtr(ast::val(astv)), astv);
 }
 
 value* translator::operator()(ast::pre_variable const& astv)
 {
-  if (ast::attr(astv).lval)
+  if (isLval(astv))
     throw error("Pre-defined variables cannnot be assigned", ast::attr(astv).where,
                 errorType::Translate);
 
   auto const name = llvm::StringRef(ast::val(astv)).ltrim('@');
   if (auto fp = module_->getLLVMModule()->getFunction(name))
-    return new value(fp, astv);
+    return region_->makeValue(fp, astv);
   else {
     if (name.equals("import")) {
       auto itm = ast::attr(astv).attributes.find("m");
@@ -351,7 +616,7 @@ value* translator::operator()(ast::pre_variable const& astv)
         throw error("Import path isn't specified", ast::attr(astv).where, errorType::Translate);
       }
     } else if (name.equals("self")) {
-      if (ast::attr(astv).lval)
+      if (isLval(astv))
         throw error("Assigning to @self is not allowed", ast::attr(astv).where,
                     errorType::Translate);
 
@@ -369,9 +634,9 @@ value* translator::operator()(ast::variable const& astv)
 {
   auto it = thisScope_->symbols().find(ast::val(astv));
   if (it == thisScope_->symbols().end()) {
-    if (ast::attr(astv).lval) {
+    if (isLval(astv)) {
       // not found in symbols & to be assigned -> declaration
-      auto vp = new value(nullptr, astv);
+      auto vp = region_->makeValue(nullptr, astv);
       vp->setName(ast::val(astv));
       return vp;
     } else {
@@ -381,7 +646,7 @@ value* translator::operator()(ast::variable const& astv)
   } else {
     auto vp = it->second;
     vp->setName(ast::val(astv));
-    if (ast::attr(astv).lval || vp->getType()->isLazy() || !vp->getType()->isFundamental())
+    if (isLval(astv) || vp->getType()->isLazy() || !vp->getType()->isFundamental())
       return vp->copy();
     else
       return vp->copyWithNewLLVMValue(builder_.CreateLoad(vp->getLLVM()));
@@ -390,17 +655,17 @@ value* translator::operator()(ast::variable const& astv)
 
 value* translator::operator()(ast::identifier const& astv)
 {
-  return new value();  // void
+  return region_->makeValue();  // void
 }
 
 value* translator::operator()(ast::struct_key const& astv)
 {
-  return new value();  // void
+  return region_->makeValue();  // void
 }
 
 value* translator::operator()(ast::array const& astv)
 {
-  if (ast::attr(astv).lval)
+  if (isLval(astv))
     throw error("An array constant is not to be assigned", ast::attr(astv).where,
                 errorType::Translate);
 
@@ -413,7 +678,7 @@ value* translator::operator()(ast::array const& astv)
   t              = firstelem->getType()->isFundamental() ? t : t->getPointerElementType();
   auto aryType   = llvm::ArrayType::get(t, ast::val(astv).size());
   auto aryPtr    = builder_.CreateAlloca(aryType);  // Allocate necessary memory
-  auto destv     = new value(aryPtr, astv);
+  auto destv     = region_->makeValue(aryPtr, astv);
 
   std::vector<value*> values;
   for (auto const x : ast::val(astv) | boost::adaptors::indexed()) {
@@ -436,7 +701,7 @@ value* translator::operator()(ast::array const& astv)
     std::string str = std::to_string(v.index());
     // not good way...? (many to_string)
 
-    if (!copyFull(v.value(), new value(p, v.value()->getAst()), str, p, destv)) {
+    if (!copyFull(v.value(), region_->makeValue(p, v.value()->getAst()), str, p, destv)) {
       assert(false && "Assigned with wrong type during construction of the structure");
     }
   }
@@ -445,13 +710,13 @@ value* translator::operator()(ast::array const& astv)
 
 value* translator::operator()(ast::arglist const& astv)
 {
-  return new value();  // void
+  return region_->makeValue();  // void
 }
 
 value* translator::operator()(ast::structure const& astv)
 {
   std::vector<llvm::Type*> fields;
-  auto destv = new value(nullptr, astv);
+  auto destv = region_->makeValue(nullptr, astv);
 
   for (auto const m : ast::val(astv) | boost::adaptors::indexed()) {
     auto vp                                     = boost::apply_visitor(*this, m.value().second);
@@ -464,16 +729,7 @@ value* translator::operator()(ast::structure const& astv)
     }
   }
 
-  llvm::StructType* structTy = llvm::StructType::create(module_->getContext());
-  structTy->setBody(fields);
-  structTy->setName("user_type");
-
-  for (auto t : module_->getLLVMModule()->getIdentifiedStructTypes()) {
-    if (structTy->isLayoutIdentical(t)) {
-      structTy = t;
-      break;
-    }
-  }
+  auto structTy = getStructType(fields, "user_type");
 
   auto ptr = builder_.CreateAlloca(structTy);
   destv->setLLVM(ptr);
@@ -483,7 +739,7 @@ value* translator::operator()(ast::structure const& astv)
     if (!v.second->getType()->isLazy()) {
       destv->fields()[v.first] = i;
       auto p                   = builder_.CreateStructGEP(structTy, ptr, i);
-      if (!copyFull(v.second, new value(p, v.second->getAst()), v.first, p, destv)) {
+      if (!copyFull(v.second, region_->makeValue(p, v.second->getAst()), v.first, p, destv)) {
         assert(false && "Assigned with wrong type during construction of the structure");
       }
       i++;
@@ -495,7 +751,7 @@ value* translator::operator()(ast::structure const& astv)
 
 value* translator::operator()(ast::function const& fcv)
 {
-  if (ast::attr(fcv).lval)
+  if (isLval(fcv))
     throw error("A function constant is not to be assigned", ast::attr(fcv).where,
                 errorType::Translate);
 
@@ -507,45 +763,53 @@ value* translator::operator()(ast::function const& fcv)
   auto& args                    = ast::val(fcv).first;
   llvm::FunctionType* func_type = llvm::FunctionType::get(
       builder_.getVoidTy(), std::vector<llvm::Type*>(args.size(), builder_.getInt32Ty()), false);
-  llvm::Function* func =
-      llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, func_name, nullptr);
-
-  auto destv = new value(func, fcv, true);  // is_lazy = true
-
-  if (std::all_of(args.begin(), args.end(),
-                  [](auto& x) {
-                    return ast::attr(x).attributes.find("type") != ast::attr(x).attributes.end();
-                  }) &&
-      ast::attr(fcv).attributes.find("lazy") == ast::attr(fcv).attributes.end()) {
-    std::vector<value*> arg_values;
-    for (auto const& a : args) {
-      llvm::SMDiagnostic err;
-      auto type_name = ast::attr(a).attributes.at("type");
-      auto t         = llvm::parseType(type_name, err, *(module_->getLLVMModule()));
-      if (!t) {
-        llvm::raw_os_ostream stream(std::cerr);
-        err.print("", stream);
-        throw error("Failed to parse type name \"" + type_name + "\"", ast::attr(a).where,
-                    errorType::Translate);
-      }
-      arg_values.push_back(new value(builder_.CreateLoad(builder_.CreateAlloca(t)), a));
-    }
-    return evaluate(destv, arg_values, *this);
-  } else {  // lazy evaluation route
+  auto destv = region_->makeValue(region_->makeLazyFunction(func_type, func_name), fcv,
+                                  true);  // is_lazy = true
+
+  // unless exported, members of imported modules are compiled when referred to; see instantiate()
+  if (hasSignature(fcv) && (!hasFlag("defer-functions") || !func_name.empty()))
+    return compileWithSignature(destv);
+  else  // lazy evaluation route
     return destv;
+}
+
+value* translator::compileWithSignature(value* v)
+{
+  std::vector<value*> arg_values;
+  for (auto const& a : ast::val(ast::unpack<ast::function>(v->getAst())).first) {
+    llvm::SMDiagnostic err;
+    auto type_name = ast::attr(a).attributes.at("type");
+    auto t         = llvm::parseType(type_name, err, *(module_->getLLVMModule()));
+    if (!t) {
+      llvm::raw_os_ostream stream(std::cerr);
+      err.print("", stream);
+      throw error("Failed to parse type name \"" + type_name + "\"", ast::attr(a).where,
+                  errorType::Translate);
+    }
+    // only the type of an argument is looked at, so no code is emitted for it
+    arg_values.push_back(region_->makeValue(llvm::UndefValue::get(t), a));
   }
+  return evaluate(v, arg_values, *this);
+}
+
+value* translator::instantiate(value* v)
+{
+  if (v->getType()->isLazy() && ast::isa<ast::function>(v->getAst()) &&
+      hasSignature(ast::unpack<ast::function>(v->getAst())))
+    return compileWithSignature(v);
+  return v;
 }
 
 value* translator::operator()(ast::scope const& scv)
 {
-  if (ast::attr(scv).lval)
+  if (isLval(scv))
     throw error("A scope constant is not to be assigned", ast::attr(scv).where,
                 errorType::Translate);
 
   auto bb = llvm::BasicBlock::Create(module_->getContext());  // empty
 
-  auto destv = new value(bb, scv, true);  // is_lazy = true
-  destv->symbols().insert(thisScope_->symbols().begin(), thisScope_->symbols().end());
+  auto destv = region_->makeValue(bb, scv, true);  // is_lazy = true
+  destv->symbols() = thisScope_->symbols();
 
   return destv;
 }
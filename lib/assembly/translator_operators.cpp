@@ -129,18 +129,18 @@ value* translator::apply_op(ast::binary_op<ast::add> const& op, std::vector<valu
 {
   if (std::none_of(args.begin(), args.end(),
                    [](auto const& x) { return x->getType()->getLLVM()->isDoubleTy(); }))
-    return new value(builder_.CreateAdd(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateAdd(args[0]->getLLVM(), args[1]->getLLVM()), op);
   else
-    return new value(builder_.CreateFAdd(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateFAdd(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::sub> const& op, std::vector<value*> const& args)
 {
   if (std::none_of(args.begin(), args.end(),
                    [](auto const& x) { return x->getType()->getLLVM()->isDoubleTy(); }))
-    return new value(builder_.CreateSub(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateSub(args[0]->getLLVM(), args[1]->getLLVM()), op);
   else
-    return new value(builder_.CreateFSub(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateFSub(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::pow> const& op, std::vector<value*> const& args)
@@ -163,67 +163,67 @@ value* translator::apply_op(ast::binary_op<ast::pow> const& op, std::vector<valu
   arg_values.push_back(lv);
   arg_values.push_back(args[1]->getLLVM());
   auto* res = builder_.CreateCall(fpow, llvm::ArrayRef<llvm::Value*>(arg_values));
-  return new value(args[1]->getType()->getLLVM()->isIntegerTy()
-                       ? builder_.CreateFPToSI(res, args[1]->getType()->getLLVM())
-                       : res,
-                   op);
+  return region_->makeValue(args[1]->getType()->getLLVM()->isIntegerTy()
+                                ? builder_.CreateFPToSI(res, args[1]->getType()->getLLVM())
+                                : res,
+                            op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::mul> const& op, std::vector<value*> const& args)
 {
   if (std::none_of(args.begin(), args.end(),
                    [](auto const& x) { return x->getType()->getLLVM()->isDoubleTy(); }))
-    return new value(builder_.CreateMul(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateMul(args[0]->getLLVM(), args[1]->getLLVM()), op);
   else
-    return new value(builder_.CreateFMul(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateFMul(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::div> const& op, std::vector<value*> const& args)
 {
   if (std::none_of(args.begin(), args.end(),
                    [](auto const& x) { return x->getType()->getLLVM()->isDoubleTy(); }))
-    return new value(builder_.CreateSDiv(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateSDiv(args[0]->getLLVM(), args[1]->getLLVM()), op);
   else
-    return new value(builder_.CreateFDiv(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateFDiv(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::rem> const& op, std::vector<value*> const& args)
 {
   if (std::none_of(args.begin(), args.end(),
                    [](auto const& x) { return x->getType()->getLLVM()->isDoubleTy(); }))
-    return new value(builder_.CreateSRem(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateSRem(args[0]->getLLVM(), args[1]->getLLVM()), op);
   else
-    return new value(builder_.CreateFRem(args[0]->getLLVM(), args[1]->getLLVM()), op);
+    return region_->makeValue(builder_.CreateFRem(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::shl> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateShl(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateShl(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::shr> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateLShr(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateLShr(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::iand> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateAnd(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateAnd(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::ior> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateOr(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateOr(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::ixor> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateXor(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateXor(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::land> const& op, std::vector<value*> const& args)
 {
-  return new value(
+  return region_->makeValue(
       builder_.CreateAnd(builder_.CreateICmpNE(args[0]->getLLVM(),
                                                llvm::Constant::getNullValue(builder_.getInt1Ty())),
                          builder_.CreateICmpNE(args[1]->getLLVM(),
@@ -233,7 +233,7 @@ value* translator::apply_op(ast::binary_op<ast::land> const& op, std::vector<val
 
 value* translator::apply_op(ast::binary_op<ast::lor> const& op, std::vector<value*> const& args)
 {
-  return new value(
+  return region_->makeValue(
       builder_.CreateOr(builder_.CreateICmpNE(args[0]->getLLVM(),
                                               llvm::Constant::getNullValue(builder_.getInt1Ty())),
                         builder_.CreateICmpNE(args[1]->getLLVM(),
@@ -243,32 +243,32 @@ value* translator::apply_op(ast::binary_op<ast::lor> const& op, std::vector<valu
 
 value* translator::apply_op(ast::binary_op<ast::eeq> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateICmpEQ(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateICmpEQ(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::neq> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateICmpNE(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateICmpNE(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::gt> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateICmpSGT(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateICmpSGT(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::lt> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateICmpSLT(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateICmpSLT(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::gtq> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateICmpSGE(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateICmpSGE(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::ltq> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateICmpSLE(args[0]->getLLVM(), args[1]->getLLVM()), op);
+  return region_->makeValue(builder_.CreateICmpSLE(args[0]->getLLVM(), args[1]->getLLVM()), op);
 }
 
 value* translator::apply_op(ast::binary_op<ast::assign> const& op, std::vector<value*> const& args)
@@ -303,15 +303,21 @@ value* translator::apply_op(ast::binary_op<ast::assign> const& op, std::vector<v
       auto va    = ast::unpack<ast::variable>(ast::val(op)[0]);
       auto thety = args[1]->getType()->isFundamental() ? rval->getType()
                                                        : rval->getType()->getPointerElementType();
-      if (ast::attr(va).attributes.count("heap"))
+      if (args[1]->getType()->isLazy())  // lives only in the symbol table
+        lval = nullptr;
+      else if (ast::attr(va).attributes.count("heap"))
         lval = createGCMalloc(thety, nullptr, n);
+      else if (hasFlag("repl") && thisScope_ == rootScope_)  // must outlive the line declaring it
+        lval = new llvm::GlobalVariable(*module_->getLLVMModule(), thety, false,
+                                        llvm::GlobalValue::ExternalLinkage,
+                                        llvm::Constant::getNullValue(thety), n);
       else
         lval = builder_.CreateAlloca(thety, nullptr, n);
 
       if (!ast::attr(va).attributes.count("mut"))
-        args[1]->getType()->isConst(true);
+        args[1]->setConst(true);
       else
-        args[1]->getType()->isConst(false);
+        args[1]->setConst(false);
     }
   } else {
     if (args[0]->getType()->isConst()) {
@@ -332,10 +338,10 @@ value* translator::apply_op(ast::binary_op<ast::call> const& op, std::vector<val
 {
   bool isadot = ast::isa<ast::binary_op<ast::adot>>(ast::val(op)[0]);
   bool isodot = ast::isa<ast::binary_op<ast::odot>>(ast::val(op)[0]) || isadot;
-  ast::expr op_unpacked;
+  ast::expr const* op_unpacked = nullptr;
   if (isodot) {
-    op_unpacked = isadot ? ast::val(ast::unpack<ast::binary_op<ast::adot>>(ast::val(op)[0]))[0]
-                         : ast::val(ast::unpack<ast::binary_op<ast::odot>>(ast::val(op)[0]))[0];
+    op_unpacked = isadot ? &ast::val(ast::unpack<ast::binary_op<ast::adot>>(ast::val(op)[0]))[0]
+                         : &ast::val(ast::unpack<ast::binary_op<ast::odot>>(ast::val(op)[0]))[0];
   }
 
   assert(args[1]->getType()->isVoid());  // args[1] should be arglist
@@ -355,7 +361,7 @@ value* translator::apply_op(ast::binary_op<ast::call> const& op, std::vector<val
     std::vector<llvm::Value*> arg_values;
     ret_table_t* ret_table = nullptr;
 
-    auto arglist = ast::unpack<ast::arglist>(ast::val(op)[1]);
+    auto& arglist = ast::unpack<ast::arglist>(ast::val(op)[1]);
 
     if (!args[0]->getType()->isLazy()) {
       tocall = args[0]->getLLVM();
@@ -406,7 +412,7 @@ value* translator::apply_op(ast::binary_op<ast::call> const& op, std::vector<val
           arg_values.push_back(rv->getLLVM());
       }
       if (isodot) {
-        auto ob_parent = boost::apply_visitor(*this, op_unpacked);
+        auto ob_parent = boost::apply_visitor(*this, *op_unpacked);
         vary.push_back(ob_parent);
         arg_values.push_back(ob_parent->getLLVM());
       }
@@ -416,14 +422,13 @@ value* translator::apply_op(ast::binary_op<ast::call> const& op, std::vector<val
       ret_table = v->getRetTable();
     }
 
-    auto destv =
-        new value(builder_.CreateCall(tocall, llvm::ArrayRef<llvm::Value*>(arg_values)), op);
+    auto destv = region_->makeValue(
+        builder_.CreateCall(tocall, llvm::ArrayRef<llvm::Value*>(arg_values)), op);
     if (ret_table)
       destv->applyRetTable(ret_table);
 
-    if (isadot && !ast::attr(op).survey) {
-      auto lvaled               = ast::set_lval(op_unpacked, true);
-      std::vector<value*> argvs = {boost::apply_visitor(*this, lvaled), destv};
+    if (isadot) {
+      std::vector<value*> argvs = {translateAsLval(*op_unpacked), destv};
       /* constructing ast::binary_op with dummy arguments */
       return apply_op(ast::set_where(ast::binary_op<ast::assign>{{op, op}}, ast::attr(op).where),
                       argvs);
@@ -461,7 +466,8 @@ value* translator::apply_op(ast::binary_op<ast::at> const& op, std::vector<value
       throw error("Index " + std::to_string(aindex) + " is out of range.", ast::attr(op).where,
                   errorType::Translate);
     }
-    auto ep = it->second;
+    // the element itself is shared by every copy of the array
+    auto ep = it->second->copy();
 
     if (!ep->getType()->isLazy()) {
       std::vector<llvm::Value*> idxList = {builder_.getInt32(0), builder_.getInt32(aindex)};
@@ -471,8 +477,8 @@ value* translator::apply_op(ast::binary_op<ast::at> const& op, std::vector<value
     }
     ep->setName(istr);
 
-    if (ast::attr(op).lval || ep->getType()->isLazy() || !ep->getType()->isFundamental())
-      return ep->copy();
+    if (isLval(op) || ep->getType()->isLazy() || !ep->getType()->isFundamental())
+      return ep;
     else
       return ep->copyWithNewLLVMValue(builder_.CreateLoad(ep->getLLVM()));
   } else {  // specifing index with non-constant integer or pointer to pointer
@@ -496,11 +502,11 @@ value* translator::apply_op(ast::binary_op<ast::at> const& op, std::vector<value
       ep = builder_.CreateGEP(lval->getType()->getPointerElementType(), lval, rval);
     }
 
-    if (ast::attr(op).lval || ep->getType()->getPointerElementType()->isStructTy() ||
+    if (isLval(op) || ep->getType()->getPointerElementType()->isStructTy() ||
         ep->getType()->getPointerElementType()->isArrayTy())
-      return new value(ep, op);
+      return region_->makeValue(ep, op);
     else
-      return new value(builder_.CreateLoad(ep), op);
+      return region_->makeValue(builder_.CreateLoad(ep), op);
   }
 }
 
@@ -511,6 +517,21 @@ value* translator::apply_op(ast::binary_op<ast::dot> const& op, std::vector<valu
   assert(ast::isa<ast::struct_key>(ast::val(op)[1]) && "rhs of dot operator must be a struct key");
   auto id = ast::val(ast::unpack<ast::struct_key>(ast::val(op)[1]));
 
+  if (auto const declarations = args[0]->getDeclarations()) {  // member of an import
+    if (isLval(op))
+      throw error("Members of an imported module cannot be assigned", ast::attr(op).where,
+                  errorType::Translate);
+    auto const it = declarations->find(id);
+    if (it == declarations->end())
+      throw error("No function named \"" + id + "\" in the imported module", ast::attr(op).where,
+                  errorType::Translate);
+
+    auto elm = region_->makeValue(declareFunction(id, it->second), op);
+    elm->setParent(args[0]);
+    elm->setName(id);
+    return elm;
+  }
+
   if (!lval->getType()->isPointerTy())
     throw error("Cannot get \"" + id + "\" from non-pointer type " + getNameString(lval->getType()),
                 ast::attr(op).where, errorType::Translate);
@@ -522,25 +543,37 @@ value* translator::apply_op(ast::binary_op<ast::dot> const& op, std::vector<valu
         "Cannot get \"" + id + "\" from non-structure type " + getNameString(lval->getType()),
         ast::attr(op).where, errorType::Translate);
 
-  auto elm = args[0]->symbols().find(id);
+  auto it = args[0]->symbols().find(id);
 
-  if (elm == args[0]->symbols().end()) {
+  if (it == args[0]->symbols().end()) {
     throw error("No member named \"" + id + "\" in the structure", ast::attr(op).where,
                 errorType::Translate);
   }
 
-  if (!elm->second->getType()->isLazy()) {
+  // members may be shared with other copies of the structure; don't modify them in place
+  auto elm = it->second->copy();
+
+  if (!elm->getType()->isLazy()) {
     auto ptr = builder_.CreateStructGEP(lval->getType()->getPointerElementType(), lval,
-                                        args[0]->fields()[id]);
-    elm->second->setLLVM(ptr);
+                                        args[0]->fields().at(id));
+    elm->setLLVM(ptr);
+  }
+  elm->setName(id);
+
+  if (!isLval(op) && elm->getType()->isLazy()) {  // members of imports are compiled on first use
+    auto inst = instantiate(elm);
+    if (inst != elm) {
+      inst = inst->copy();
+      inst->setParent(args[0]);
+      inst->setName(id);
+      return inst;
+    }
   }
-  elm->second->setName(id);
 
-  if (ast::attr(op).lval || elm->second->getType()->isLazy() ||
-      !elm->second->getType()->isFundamental())
-    return elm->second->copy();
+  if (isLval(op) || elm->getType()->isLazy() || !elm->getType()->isFundamental())
+    return elm;
   else
-    return elm->second->copyWithNewLLVMValue(builder_.CreateLoad(elm->second->getLLVM()));
+    return elm->copyWithNewLLVMValue(builder_.CreateLoad(elm->getLLVM()));
 }
 
 value* translator::apply_op(ast::binary_op<ast::odot> const& op, std::vector<value*> const& args)
@@ -566,14 +599,14 @@ value* translator::apply_op(ast::binary_op<ast::adot> const& op, std::vector<val
 value* translator::apply_op(ast::single_op<ast::ret> const& op, std::vector<value*> const& args)
 {
   builder_.CreateRet(args[0]->getLLVM());
-  auto newv = new value();
+  auto newv = region_->makeValue();
   newv->setRetTable(args[0]->generateRetTable());
   return newv;  // void+rettable
 }
 
 value* translator::apply_op(ast::single_op<ast::lnot> const& op, std::vector<value*> const& args)
 {
-  return new value(
+  return region_->makeValue(
       builder_.CreateXor(builder_.CreateICmpNE(args[0]->getLLVM(),
                                                llvm::Constant::getNullValue(builder_.getInt1Ty())),
                          builder_.getInt32(1)),
@@ -582,7 +615,7 @@ value* translator::apply_op(ast::single_op<ast::lnot> const& op, std::vector<val
 
 value* translator::apply_op(ast::single_op<ast::inot> const& op, std::vector<value*> const& args)
 {
-  return new value(builder_.CreateXor(args[0]->getLLVM(), builder_.getInt32(1)), op);
+  return region_->makeValue(builder_.CreateXor(args[0]->getLLVM(), builder_.getInt32(1)), op);
 }
 
 value* translator::apply_op(ast::single_op<ast::inc> const& op, std::vector<value*> const& args)
@@ -627,8 +660,8 @@ value* translator::apply_op(ast::ternary_op<ast::cond> const& op, std::vector<va
 
     assert(ast::isa<ast::scope>(args[1]->getAst()) && ast::isa<ast::scope>(args[2]->getAst()) &&
            "Applying non-scope value as scope");
-    auto secondsc = ast::unpack<ast::scope>(args[1]->getAst());
-    auto thirdsc  = ast::unpack<ast::scope>(args[2]->getAst());
+    auto& secondsc = ast::unpack<ast::scope>(args[1]->getAst());
+    auto& thirdsc  = ast::unpack<ast::scope>(args[2]->getAst());
 
     builder_.SetInsertPoint(thenbb);
     thisScope_ = args[1];
@@ -656,7 +689,7 @@ value* translator::apply_op(ast::ternary_op<ast::cond> const& op, std::vector<va
     if (!mergebbShouldBeErased)
       builder_.SetInsertPoint(mergebb);
 
-    return new value();  // Void
+    return region_->makeValue();  // Void
   } else {
     if (args[1]->getType()->isLazy() || args[2]->getType()->isLazy())
       throw error("Conditional operator with lazy value is currently not supported",
@@ -672,7 +705,7 @@ value* translator::apply_op(ast::ternary_op<ast::cond> const& op, std::vector<va
     auto pp = builder_.GetInsertPoint();
 
     auto destlv =
-        builder_.CreateAlloca(ast::attr(op).lval ? args[1]->getType()->getLLVM()->getPointerTo()
+        builder_.CreateAlloca(isLval(op) ? args[1]->getType()->getLLVM()->getPointerTo()
                                                  : args[1]->getType()->getLLVM());
 
     llvm::BasicBlock* thenbb =
@@ -682,10 +715,8 @@ value* translator::apply_op(ast::ternary_op<ast::cond> const& op, std::vector<va
     llvm::BasicBlock* mergebb =
         llvm::BasicBlock::Create(module_->getContext(), "", builder_.GetInsertBlock()->getParent());
 
-    auto lvaled_then = ast::set_lval(ast::val(op)[1], true);
-    auto lvaled_else = ast::set_lval(ast::val(op)[2], true);
-    value* thenv     = ast::attr(op).lval ? boost::apply_visitor(*this, lvaled_then) : args[1];
-    value* elsev     = ast::attr(op).lval ? boost::apply_visitor(*this, lvaled_else) : args[2];
+    value* thenv = isLval(op) ? translateAsLval(ast::val(op)[1]) : args[1];
+    value* elsev = isLval(op) ? translateAsLval(ast::val(op)[2]) : args[2];
 
     builder_.SetInsertPoint(thenbb);
     builder_.CreateStore(thenv->getLLVM(), destlv);
@@ -698,7 +729,7 @@ value* translator::apply_op(ast::ternary_op<ast::cond> const& op, std::vector<va
 
     builder_.SetInsertPoint(mergebb);
 
-    auto destv       = new value(builder_.CreateLoad(destlv), op);
+    auto destv       = region_->makeValue(builder_.CreateLoad(destlv), op);
     destv->symbols() = args[1]->symbols();
     destv->fields()  = args[1]->fields();
     return destv;
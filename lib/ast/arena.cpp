@@ -0,0 +1,53 @@
+/**
+* @file arena.cpp
+*
+* (c) copyright 2017 coord.e
+*
+* This file is part of scopion.
+*
+* scopion is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* scopion is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with scopion.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scopion/ast/arena.hpp"
+
+#include <algorithm>
+
+namespace scopion
+{
+namespace ast
+{
+void* arena::allocate(size_t size, size_t align)
+{
+  auto space = left_;
+  void* p    = head_;
+  if (!p || !std::align(align, size, p, space)) {
+    auto const n = std::max(chunk_size, size + align);
+    chunks_.emplace_back(new char[n]);
+    p     = chunks_.back().get();
+    space = n;
+    std::align(align, size, p, space);
+  }
+  head_ = static_cast<char*>(p) + size;
+  left_ = space - size;
+  return p;
+}
+
+std::shared_ptr<arena>& arena::current()
+{
+  static thread_local std::shared_ptr<arena> a;
+  return a;
+}
+
+}  // namespace ast
+}  // namespace scopion
@@ -33,6 +33,7 @@
 
 #include <array>
 #include <map>
+#include <memory>
 #include <type_traits>
 
 namespace scopion
@@ -45,40 +46,24 @@ namespace grammar
 {
 namespace detail
 {
-class rangePathHolder
-{
-private:
-  rangePathHolder()  = default;
-  ~rangePathHolder() = default;
-  strRange _current_range;
-  boost::optional<boost::filesystem::path> _current_path;
-
-public:
-  rangePathHolder(rangePathHolder const&) = delete;
-  rangePathHolder& operator=(rangePathHolder const&) = delete;
-  rangePathHolder(rangePathHolder&&)                 = delete;
-  rangePathHolder& operator=(rangePathHolder&&) = delete;
-
-  static rangePathHolder& getInstance()
+// The file being parsed, passed to semantic actions through the
+// parser context (see source_tag) so that parses on other threads do not interfere
+struct source_position {
+  std::shared_ptr<sourceFile const> file;
+
+  locationInfo getLocation(std::string::const_iterator where) const
   {
-    static rangePathHolder instance;
-    return instance;
+    return locationInfo(file,
+                        static_cast<uint32_t>(std::distance(file->getCode().cbegin(), where)));
   }
-
-  void setRange(strRange range) { _current_range = range; }
-
-  strRange getRange() { return _current_range; }
-
-  void setPath(boost::optional<boost::filesystem::path> const& path) { _current_path = path; }
-
-  boost::optional<boost::filesystem::path> getPath() { return _current_path; }
 };
 
-template <typename T>
-T set_where_r(T val, strRange where)
+struct source_tag;
+
+template <typename T, typename Context>
+T set_where_r(T val, Context const& ctx)
 {
-  auto& holder    = rangePathHolder::getInstance();
-  attr(val).where = locationInfo(where, holder.getRange(), holder.getPath());
+  attr(val).where = x3::get<source_tag>(ctx).getLocation(x3::_where(ctx).begin());
   return val;
 }
 
@@ -131,12 +116,12 @@ static std::string unescape(std::string const& s)
   return res;
 }
 
-static auto const assign = [](auto&& ctx) { x3::_val(ctx) = x3::_attr(ctx); };
+static auto const assign = [](auto&& ctx) { x3::_val(ctx) = std::move(x3::_attr(ctx)); };
 
 template <typename T>
 static auto const assign_str_as = [](auto&& ctx) {
   std::string str(x3::_attr(ctx).begin(), x3::_attr(ctx).end());
-  x3::_val(ctx) = set_where_r(T(str), x3::_where(ctx));
+  x3::_val(ctx) = set_where_r(T(str), ctx);
 };
 
 template <typename T, char C, bool Es = false>
@@ -148,12 +133,12 @@ static auto const assign_str_escaped_as = [](auto&& ctx) {
     else  // unused_type
       rs = rs + C;
   }
-  x3::_val(ctx) = set_where_r(T(Es ? unescape(rs) : rs), x3::_where(ctx));
+  x3::_val(ctx) = set_where_r(T(Es ? unescape(rs) : rs), ctx);
 };
 
 template <typename T>
 static auto const assign_as =
-    [](auto&& ctx) { x3::_val(ctx) = set_where_r(T(x3::_attr(ctx)), x3::_where(ctx)); };
+    [](auto&& ctx) { x3::_val(ctx) = set_where_r(T(x3::_attr(ctx)), ctx); };
 
 static auto const assign_short_func = [](auto&& ctx) {
   auto&& args = boost::fusion::at<boost::mpl::int_<0>>(x3::_attr(ctx));
@@ -161,12 +146,14 @@ static auto const assign_short_func = [](auto&& ctx) {
   std::vector<ast::identifier> result;
   std::transform(args.begin(), args.end(), std::back_inserter(result),
                  [](auto&& x) { return ast::unpack<ast::identifier>(x); });
-  x3::_val(ctx) = set_where_r(ast::function({result, {line}}), x3::_where(ctx));
+  x3::_val(ctx) = set_where_r(ast::function({result, {line}}), ctx);
 };
 
 static auto const assign_pipe = [](auto&& ctx) {
   x3::_val(ctx) = set_where_r(
-      ast::binary_op<ast::call>({x3::_attr(ctx), ast::arglist({x3::_val(ctx)})}), x3::_where(ctx));
+      ast::binary_op<ast::call>(std::array<ast::expr, 2>{
+          {std::move(x3::_attr(ctx)), ast::arglist({std::move(x3::_val(ctx))})}}),
+      ctx);
 };
 
 static auto const assign_func = [](auto&& ctx) {
@@ -175,7 +162,7 @@ static auto const assign_func = [](auto&& ctx) {
   std::vector<ast::identifier> result;
   std::transform(args.begin(), args.end(), std::back_inserter(result),
                  [](auto&& x) { return ast::unpack<ast::identifier>(x); });
-  x3::_val(ctx) = set_where_r(ast::function({result, lines}), x3::_where(ctx));
+  x3::_val(ctx) = set_where_r(ast::function({result, lines}), ctx);
 };
 
 static auto const assign_struct = [](auto&& ctx) {
@@ -185,7 +172,7 @@ static auto const assign_struct = [](auto&& ctx) {
     auto&& val   = boost::fusion::at<boost::mpl::int_<1>>(v);
     result[name] = val;
   }
-  x3::_val(ctx) = set_where_r(ast::structure(result), x3::_where(ctx));
+  x3::_val(ctx) = set_where_r(ast::structure(result), ctx);
 };
 
 template <typename Op, size_t N>
@@ -193,33 +180,39 @@ static auto const assign_op = [](auto&& ctx) {
   static_assert(N >= 3, "Wrong number of terms");
   std::array<ast::expr, N> ary;
   auto it = ary.begin();
-  *it     = x3::_val(ctx);
-  boost::fusion::for_each(x3::_attr(ctx), [&it](auto&& v) { *(++it) = v; });
-  x3::_val(ctx) = set_where_r(ast::op<Op, N>(ary), x3::_where(ctx));
+  *it     = std::move(x3::_val(ctx));
+  boost::fusion::for_each(x3::_attr(ctx), [&it](auto&& v) { *(++it) = std::move(v); });
+  x3::_val(ctx) = set_where_r(ast::op<Op, N>(std::move(ary)), ctx);
 };
 
 template <typename Op>
 auto const assign_op<Op, 2> = [](auto&& ctx) {
-  x3::_val(ctx) = set_where_r(ast::binary_op<Op>({x3::_val(ctx), x3::_attr(ctx)}), x3::_where(ctx));
+  x3::_val(ctx) = set_where_r(ast::binary_op<Op>(std::array<ast::expr, 2>{
+                                  {std::move(x3::_val(ctx)), std::move(x3::_attr(ctx))}}),
+                              ctx);
 };
 
 template <typename Op>
 auto const assign_op<Op, 1> = [](auto&& ctx) {
-  x3::_val(ctx) = set_where_r(ast::single_op<Op>({x3::_attr(ctx)}), x3::_where(ctx));
+  x3::_val(ctx) =
+      set_where_r(ast::single_op<Op>(std::array<ast::expr, 1>{{std::move(x3::_attr(ctx))}}),
+                  ctx);
 };
 
 template <>
 auto const assign_op<ast::assign, 2> = [](auto&& ctx) {
-  x3::_val(ctx) =
-      set_where_r(ast::binary_op<ast::assign>({ast::set_lval(x3::_val(ctx), true), x3::_attr(ctx)}),
-                  x3::_where(ctx));
+  x3::_val(ctx) = set_where_r(
+      ast::binary_op<ast::assign>(std::array<ast::expr, 2>{
+          {ast::set_lval(std::move(x3::_val(ctx)), true), std::move(x3::_attr(ctx))}}),
+      ctx);
 };
 
 template <>
 auto const assign_op<ast::call, 2> = [](auto&& ctx) {
-  x3::_val(ctx) = set_where_r(ast::binary_op<ast::call>({ast::set_to_call(x3::_val(ctx), true),
-                                                         ast::arglist(x3::_attr(ctx))}),
-                              x3::_where(ctx));
+  x3::_val(ctx) = set_where_r(
+      ast::binary_op<ast::call>(std::array<ast::expr, 2>{
+          {ast::set_to_call(std::move(x3::_val(ctx)), true), ast::arglist(x3::_attr(ctx))}}),
+      ctx);
 };
 
 template <>
@@ -227,7 +220,7 @@ auto const assign_op<ast::inc, 1> = [](auto&& ctx) {
   x3::_val(ctx) = set_where_r(
       ast::binary_op<ast::assign>({ast::set_lval(x3::_attr(ctx), true),
                                    ast::binary_op<ast::add>({x3::_attr(ctx), ast::integer(1)})}),
-      x3::_where(ctx));
+      ctx);
 };
 
 template <>
@@ -235,7 +228,15 @@ auto const assign_op<ast::dec, 1> = [](auto&& ctx) {
   x3::_val(ctx) = set_where_r(
       ast::binary_op<ast::assign>({ast::set_lval(x3::_attr(ctx), true),
                                    ast::binary_op<ast::sub>({x3::_attr(ctx), ast::integer(1)})}),
-      x3::_where(ctx));
+      ctx);
+};
+
+template <typename Op>
+static auto const assign_post_op = [](auto&& ctx) {
+  x3::_val(ctx) = set_where_r(
+      ast::binary_op<ast::assign>({ast::set_lval(x3::_val(ctx), true),
+                                   ast::binary_op<Op>({x3::_val(ctx), ast::integer(1)})}),
+      ctx);
 };
 
 static auto const assign_attr = [](auto&& ctx) {
@@ -245,7 +246,8 @@ static auto const assign_attr = [](auto&& ctx) {
   // ast::attribute_val
   std::string keystr = ast::val(ast::unpack<ast::identifier>(key));
   std::string valstr = val ? ast::val(ast::unpack<ast::attribute_val>(*val)) : "";
-  x3::_val(ctx)      = ast::set_attr(x3::_val(ctx), keystr, valstr);
+
+  ast::attr(x3::_val(ctx)).attributes[keystr] = valstr;
 };
 
 }  // namespace detail
@@ -383,15 +385,15 @@ auto const call_expr_def = attr_expr[detail::assign] >>
                               ")")[detail::assign_op<ast::call, 2>] |
                              ("[" > expression > "]")[detail::assign_op<ast::at, 2>]);
 
-auto const post_sinop_expr_def = (call_expr >> "++")[detail::assign_op<ast::inc, 1>] |
-                                 (call_expr >> "--")[detail::assign_op<ast::dec, 1>] |
-                                 call_expr[detail::assign];
+auto const post_sinop_expr_def = call_expr[detail::assign] >>
+                                 -(x3::lit("++")[detail::assign_post_op<ast::add>] |
+                                   x3::lit("--")[detail::assign_post_op<ast::sub>]);
 
-auto const pre_sinop_expr_def = post_sinop_expr[detail::assign] |
-                                ("!" > post_sinop_expr)[detail::assign_op<ast::lnot, 1>] |
+auto const pre_sinop_expr_def = ("!" > post_sinop_expr)[detail::assign_op<ast::lnot, 1>] |
                                 ("~" > post_sinop_expr)[detail::assign_op<ast::inot, 1>] |
                                 ("++" > post_sinop_expr)[detail::assign_op<ast::inc, 1>] |
-                                ("--" > post_sinop_expr)[detail::assign_op<ast::dec, 1>];
+                                ("--" > post_sinop_expr)[detail::assign_op<ast::dec, 1>] |
+                                post_sinop_expr[detail::assign];
 
 auto const pow_expr_def = pre_sinop_expr[detail::assign] >>
                           *(("**" > pre_sinop_expr)[detail::assign_op<ast::pow, 2>]);
@@ -436,14 +438,13 @@ auto const cond_expr_def = lor_expr[detail::assign] >>
                            *(("?" > lor_expr > ":" > lor_expr)[detail::assign_op<ast::cond, 3>]);
 
 auto const assign_expr_def =
-    cond_expr[detail::assign] >> "=" >> assign_expr[detail::assign_op<ast::assign, 2>] |
-    cond_expr[detail::assign];
+    cond_expr[detail::assign] >> -("=" >> assign_expr[detail::assign_op<ast::assign, 2>]);
 
 auto const pipe_expr_def = assign_expr[detail::assign] >>
                            *(("->" > assign_expr)[detail::assign_pipe]);
 
 auto const ret_expr_def =
-    pipe_expr[detail::assign] | ("|>" > pipe_expr)[detail::assign_op<ast::ret, 1>];
+    ("|>" > pipe_expr)[detail::assign_op<ast::ret, 1>] | pipe_expr[detail::assign];
 
 auto const expression_def = ret_expr[detail::assign];
 
@@ -490,9 +491,7 @@ struct expression {
   {
     throw error(x.which() + " is expected but there is " +
                     (x.where() == last ? "nothing" : std::string{*x.where()}),
-                locationInfo(boost::make_iterator_range(x.where(), x.where()),
-                             boost::make_iterator_range(first, last),
-                             detail::rangePathHolder::getInstance().getPath()),
+                x3::get<detail::source_tag>(context).getLocation(x.where()),
                 errorType::Parse);
     return x3::error_handler_result::fail;
   }
@@ -506,30 +505,27 @@ boost::optional<ast::expr> parse(std::string const& code,
 {
   ast::expr tree;
 
-  auto& holder = grammar::detail::rangePathHolder::getInstance();
+  auto const file = std::make_shared<sourceFile const>(code, path);
+  auto const& src = file->getCode();
+
+  grammar::detail::source_position const position{file};
 
-  auto cr = holder.getRange();
-  auto cf = holder.getPath();
-  holder.setRange(strRange(code.begin(), code.end()));
-  holder.setPath(path);
+  ast::arena_scope nodes(std::make_shared<ast::arena>());
 
   auto const space_comment =
       "//" > *(x3::char_ - '\n') > '\n' | "/*" > *(x3::char_ - "*/") > "*/" | x3::space;
 
   try {
-    auto it = code.cbegin();
-    if (!x3::phrase_parse(it, code.cend(), grammar::expression, space_comment, tree))
+    auto it = src.cbegin();
+    auto const parser = x3::with<grammar::detail::source_tag>(position)[grammar::expression];
+    if (!x3::phrase_parse(it, src.cend(), parser, space_comment, tree))
       throw error("Unknown error has detected", locationInfo{}, errorType::Parse);
-    if (it != code.cend())
+    if (it != src.cend())
       throw error("Parser couldn't reach at the end of file", locationInfo{}, errorType::Parse);
   } catch (error& e) {
     err = e;
-    holder.setRange(cr);
-    holder.setPath(cf);
     return boost::none;
   }
-  holder.setRange(cr);
-  holder.setPath(cf);
 
   return tree;
 }
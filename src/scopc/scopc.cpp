@@ -19,18 +19,25 @@
  * along with scopion.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstdio>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 
 #include <llvm/ADT/Triple.h>
 #include <llvm/Support/Host.h>
+#include <llvm/Support/ThreadPool.h>
 
 #include "args.hxx"
 #include "rang.hpp"
@@ -46,6 +53,107 @@ static std::string getTmpFilePath()
   return std::string(tmpname);
 }
 
+// Reads pieces of a program from stdin line by line and evaluates each one in a session
+static int runREPL(std::vector<std::string> const& flags)
+{
+  scopion::assembly::session sess(flags);
+  std::string line;
+  while (std::cout << "> " << std::flush, std::getline(std::cin, line)) {
+    if (line.empty())
+      continue;
+
+    std::string result;
+    scopion::error err;
+    if (!sess.eval(line, result, err))
+      std::cerr << err << std::endl;
+    else if (!result.empty())
+      std::cout << result << std::endl;
+  }
+  std::cout << std::endl;
+  return 0;
+}
+
+// Calls f as the phase called name, for --time-report and --time-trace
+template <typename F>
+static auto timed(char const* name, F&& f)
+{
+  scopion::profileScope timing("phase", name);
+  return f();
+}
+
+// Writes the profile out when main returns, whichever way it does
+struct profileReport {
+  bool table;
+  std::string trace_path;
+
+  ~profileReport()
+  {
+    if (table)
+      scopion::profiler::getInstance().printTable(std::cerr);
+    if (!trace_path.empty()) {
+      std::ofstream f(trace_path);
+      scopion::profiler::getInstance().writeChromeTrace(f);
+    }
+  }
+};
+
+// Compiles the file at inpath into an object at objpath, as a single input is compiled
+static bool compileToObject(boost::filesystem::path const& inpath,
+                            std::string const& objpath,
+                            std::string const& triple,
+                            std::vector<std::string> const& flags,
+                            std::string const& entryfuncname,
+                            std::pair<uint8_t, uint8_t> const& optlevel,
+                            std::shared_ptr<scopion::assembly::import_cache> const& imports,
+                            std::string& linkerflags,
+                            scopion::error& err)
+{
+  auto code = imports->getFile(inpath.string());
+  if (!code) {
+    err = scopion::error("failed to open \"" + inpath.string() + "\"", scopion::locationInfo{},
+                         scopion::errorType::Internal);
+    return false;
+  }
+
+  auto ast = timed("parse", [&] { return scopion::parser::parse(*code, err, inpath); });
+  if (!ast)
+    return false;
+
+  scopion::assembly::translator tr(inpath, flags, entryfuncname, imports);
+
+  // a structure is a module: its functions go to the object, and the rest to the interface file
+  // which is imported in place of the source
+  if (scopion::ast::isa<scopion::ast::structure>(*ast)) {
+    std::string interface;
+    if (!timed("translate", [&] { return tr.exportModule(*ast, interface, err); }))
+      return false;
+    auto const ifpath = boost::filesystem::path(objpath).replace_extension(
+        scopion::assembly::interface_extension);
+    std::ofstream ofs(ifpath.string());
+    if (!(ofs << interface)) {
+      err = scopion::error("failed to write \"" + ifpath.string() + "\"", scopion::locationInfo{},
+                           scopion::errorType::Internal);
+      return false;
+    }
+  } else {
+    tr.createMain();
+    if (!timed("translate", [&] {
+          auto* tlv = tr.translateAST(*ast, err);
+          return tlv && tr.createMainRet(tlv, err);
+        }))
+      return false;
+  }
+
+  auto mod = tr.takeModule();
+  mod->hideUnnamedFunctions();  // the object is linked with others
+  if (!timed("verify", [&] { return mod->verify(err); }))
+    return false;
+
+  timed("optimize", [&] { mod->optimize(optlevel.first, optlevel.second); });
+  linkerflags = mod->generateLinkerFlags();
+  return timed("emit", [&] { return mod->emit(objpath, triple, false, err); });
+}
+
 int main(int argc, char* argv[])
 {
   args::ArgumentParser parser("scopc: scopion compiler", "");
@@ -64,10 +172,29 @@ int main(int argc, char* argv[])
   args::ValueFlagList<std::string> flags(parser, "flags", "Supply flags to translator", {'f'}, {});
   args::ValueFlag<std::string> entryfuncname(parser, "symbol", "Name of entry function",
                                              {'e', "entry-func"}, "main");
-  args::ValueFlag<int> optimize(parser, "level", "Set optimization level (0-3)", {'O', "optimize"},
-                                3);
+  // optimization level and size level, as given to module::optimize
+  args::MapFlag<std::string, std::pair<uint8_t, uint8_t>> optimize(
+      parser, "level", "Set optimization level", {'O', "optimize"},
+      {{"0", {0, 0}}, {"1", {1, 0}}, {"2", {2, 0}}, {"3", {3, 0}}, {"s", {2, 1}}, {"z", {2, 2}}},
+      {3, 0});
+  args::ValueFlag<unsigned> jobs(parser, "N", "Use N threads to optimize and generate objects",
+                                 {'j', "jobs"});
   args::Flag version(parser, "version", "Print version", {'V', "version"});
-  args::Positional<std::string> input_path(parser, "path", "File to compile");
+  args::Flag run(parser, "run", "JIT-compile and run the program instead of writing output",
+                 {'r', "run"});
+  args::Flag compile_only(parser, "compile-only",
+                          "Write an object per input to the current directory instead of linking",
+                          {'c', "compile-only"});
+  args::Flag lazy(parser, "lazy", "With --run, compile each function on its first call",
+                  {"lazy"});
+  args::Flag time_report(parser, "time-report",
+                         "Print how long each phase took to stderr", {"time-report"});
+  args::ValueFlag<std::string> time_trace(parser, "path",
+                                          "Write the phases as a Chrome trace_event JSON file",
+                                          {"time-trace"});
+  args::Positional<std::string> input_path(parser, "path", "File to compile, or \"repl\"");
+  args::PositionalList<std::string> run_args(
+      parser, "args", "More files to compile, or arguments passed to the program with --run");
 
   parser.helpParams.addDefault = true;
   parser.helpParams.addChoices = true;
@@ -109,6 +236,10 @@ int main(int argc, char* argv[])
     return 0;
   }
 
+  profileReport report{static_cast<bool>(time_report), args::get(time_trace)};
+  if (time_report || time_trace)
+    scopion::profiler::getInstance().enable();
+
   if (!input_path) {
     std::cerr << rang::style::reset << rang::bg::red << rang::fg::gray << "[ERROR]"
               << rang::style::reset << ": no input file specified." << std::endl
@@ -116,8 +247,93 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  if (args::get(input_path) == "repl") {
+    try {
+      return runREPL(args::get(flags));
+    } catch (scopion::error& e) {
+      std::cerr << e << std::endl;
+      return -1;
+    }
+  }
+
   auto outpath                   = args::get(output_path);
   outpath                        = outpath != "-" ? outpath : "/dev/stdout";
+
+  // several inputs (or -c) are compiled to objects on a thread pool, sharing imported files
+  if (!run && (compile_only || !args::get(run_args).empty())) {
+    if (args::get(type) != OutputType::Object) {
+      std::cerr << rang::style::reset << rang::bg::red << rang::fg::gray << "[ERROR]"
+                << rang::style::reset << ": several inputs can only be compiled to objects"
+                << std::endl;
+      return 1;
+    }
+
+    std::vector<boost::filesystem::path> inputs = {args::get(input_path)};
+    for (auto const& p : args::get(run_args))
+      inputs.push_back(p);
+
+    auto archstr = args::get(arch);
+    archstr      = archstr != "native" ? archstr : llvm::sys::getDefaultTargetTriple();
+    llvm::Triple triple(archstr);
+
+    auto const imports = std::make_shared<scopion::assembly::import_cache>();
+    // objects of separately compiled modules are passed to the linker as they are
+    std::vector<std::string> objects;
+    std::map<std::string, boost::filesystem::path> written;  // -c writes to the current directory
+    for (auto const& in : inputs) {
+      if (in.extension() == ".o") {
+        objects.push_back(in.string());
+        continue;
+      }
+      objects.push_back(compile_only ? in.stem().string() + ".o" : getTmpFilePath() + ".o");
+      auto const other = written.emplace(objects.back(), in);
+      if (!other.second) {
+        std::cerr << rang::style::reset << rang::bg::red << rang::fg::gray << "[ERROR]"
+                  << rang::style::reset << ": both " << other.first->second << " and " << in
+                  << " would be compiled to " << objects.back() << std::endl;
+        return 1;
+      }
+    }
+
+    std::vector<std::string> linkerflags(inputs.size());
+    std::vector<scopion::error> errors(inputs.size());
+    std::vector<char> succeeded(inputs.size(), true);
+    {
+      llvm::ThreadPool pool(
+          std::max(jobs ? args::get(jobs) : std::thread::hardware_concurrency(), 1u));
+      for (size_t i = 0; i < inputs.size(); i++) {
+        if (inputs[i].extension() == ".o")
+          continue;
+        pool.async([&, i] {
+          succeeded[i] = compileToObject(boost::filesystem::absolute(inputs[i]), objects[i],
+                                         triple.getTriple(), args::get(flags),
+                                         args::get(entryfuncname), args::get(optimize), imports,
+                                         linkerflags[i], errors[i]);
+        });
+      }
+      pool.wait();
+    }
+
+    bool failed = false;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      if (!succeeded[i]) {
+        std::cerr << errors[i] << std::endl;
+        failed = true;
+      }
+    }
+    if (failed)
+      return -1;
+    if (compile_only)
+      return 0;
+
+    std::string command = "clang";
+    for (size_t i = 0; i < inputs.size(); i++)
+      command += " " + objects[i] + " " + linkerflags[i];
+    return timed("link", [&] {
+      return system((command + " --target=" + triple.getTriple() + " -o " + outpath).c_str());
+    });
+  }
+
   boost::filesystem::path inpath = boost::filesystem::absolute(args::get(input_path));
   std::ifstream ifs(inpath.string());
   if (ifs.fail()) {
@@ -131,7 +347,36 @@ int main(int argc, char* argv[])
   std::string code((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
 
   scopion::error err;
-  auto ast = scopion::parser::parse(code, err, inpath);
+
+  std::vector<std::string> argv_run = {inpath.string()};
+  auto const& rest                  = args::get(run_args);
+  argv_run.insert(argv_run.end(), rest.begin(), rest.end());
+
+  // eager --run reuses the object compiled by a previous run of the same program
+  std::unique_ptr<scopion::assembly::object_cache> cache;
+  if (run && !lazy) {
+    std::vector<std::string> key = {SCOPION_VERSION,
+                                    code,
+                                    inpath.string(),
+                                    args::get(entryfuncname),
+                                    std::to_string(args::get(optimize).first),
+                                    std::to_string(args::get(optimize).second),
+                                    llvm::sys::getProcessTriple()};
+    key.insert(key.end(), args::get(flags).begin(), args::get(flags).end());
+    cache = std::make_unique<scopion::assembly::object_cache>(
+        scopion::assembly::object_cache::hash(key));
+    if (cache->load()) {
+      scopion::assembly::module cached(inpath.filename().string(), args::get(entryfuncname));
+      int status;
+      if (!timed("run", [&] { return cached.runCached(*cache, argv_run, status, err); })) {
+        std::cerr << err << std::endl;
+        return -1;
+      }
+      return status;
+    }
+  }
+
+  auto ast = timed("parse", [&] { return scopion::parser::parse(code, err, inpath); });
   if (!ast) {
     std::cerr << err << std::endl;
     return -1;
@@ -147,48 +392,79 @@ int main(int argc, char* argv[])
   scopion::assembly::translator tr(inpath, args::get(flags), args::get(entryfuncname));
   tr.createMain();
 
-  auto* tlv = tr.translateAST(*ast, err);
-  if (!tlv) {
-    std::cerr << err << std::endl;
-    return -1;
-  }
-
-  if (!tr.createMainRet(tlv, err)) {
+  if (!timed("translate", [&] {
+        auto* tlv = tr.translateAST(*ast, err);
+        return tlv && tr.createMainRet(tlv, err);
+      })) {
     std::cerr << err << std::endl;
     return -1;
   }
 
   auto mod = tr.takeModule();
 
-  if (!mod->verify(err)) {
+  if (!timed("verify", [&] { return mod->verify(err); })) {
     std::cerr << err << std::endl;
     return -1;
   }
 
-  if (auto optlevel = static_cast<uint8_t>(args::get(optimize))) {
-    mod->optimize(optlevel, optlevel);
+  auto const optlevel  = args::get(optimize).first;
+  auto const sizelevel = args::get(optimize).second;
+  // lazy mode optimizes each function as it is compiled, and split mode each partition
+  auto const split = jobs && !run && outtype == OutputType::Object;
+  if (!(run && lazy) && !split) {
+    timed("optimize", [&] { mod->optimize(optlevel, sizelevel); });
   }
 
-  auto irpath = outtype == OutputType::IR ? outpath : getTmpFilePath() + ".ll";
-  std::ofstream f(irpath);
-  mod->printIR(f);
-  f.close();
-  if (outtype == OutputType::IR)
-    return 0;
+  if (run) {
+    int status;
+    if (!timed("run", [&] {
+          return lazy ? mod->runLazily(argv_run, optlevel, sizelevel, status, err)
+                      : mod->run(argv_run, status, err, cache.get());
+        })) {
+      std::cerr << err << std::endl;
+      return -1;
+    }
+    return status;
+  }
 
-  auto asmpath = outtype == OutputType::Assembly ? outpath : getTmpFilePath() + ".s";
+  if (outtype == OutputType::IR) {
+    std::ofstream f(outpath);
+    mod->printIR(f);
+    f.close();
+    return 0;
+  }
 
   auto archstr = args::get(arch);
   archstr      = archstr != "native" ? archstr : llvm::sys::getDefaultTargetTriple();
   llvm::Triple triple(archstr);
 
-  system(("llc -relocation-model=pic -mtriple=" + triple.getTriple() + " -filetype asm " + irpath +
-          " -o=" + asmpath)
-             .c_str());
-  if (outtype == OutputType::Assembly)
-    return 0;
+  std::string emitpath;
+  if (split) {
+    std::vector<std::string> objects;
+    if (!timed("emit", [&] {
+          return mod->emitSplit(getTmpFilePath(), triple.getTriple(), optlevel, sizelevel,
+                                args::get(jobs), objects, err);
+        })) {
+      std::cerr << err << std::endl;
+      return -1;
+    }
+    for (auto const& o : objects)
+      emitpath += o + " ";
+  } else {
+    emitpath = outtype == OutputType::Assembly ? outpath : getTmpFilePath() + ".o";
+    if (!timed("emit", [&] {
+          return mod->emit(emitpath, triple.getTriple(), outtype == OutputType::Assembly, err);
+        })) {
+      std::cerr << err << std::endl;
+      return -1;
+    }
+    if (outtype == OutputType::Assembly)
+      return 0;
+  }
 
-  return system(("clang " + asmpath + " " + mod->generateLinkerFlags() +
-                 " --target=" + triple.getTriple() + " -o " + outpath)
-                    .c_str());
+  return timed("link", [&] {
+    return system(("clang " + emitpath + " " + mod->generateLinkerFlags() +
+                   " --target=" + triple.getTriple() + " -o " + outpath)
+                      .c_str());
+  });
 }
@@ -22,10 +22,25 @@
 #include "gtest/gtest.h"
 
 #include "scopion/assembly/assembly.hpp"
+#include "scopion/parser/parser.hpp"
+
+#include <llvm/IR/Instructions.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/Host.h>
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem/operations.hpp>
 #include <boost/variant.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
 namespace
 {
 using namespace scopion;
@@ -34,6 +49,65 @@ class assemblyTest : public ::testing::Test
 {
 };
 
+// A file in the temporary directory, removed when it goes out of scope
+class tempFile
+{
+  boost::filesystem::path path_;
+
+public:
+  tempFile(std::string const& extension, std::string const& contents)
+      : path_(boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path("%%%%-%%%%" + extension))
+  {
+    std::ofstream(path_.string()) << contents;
+  }
+  ~tempFile() { boost::filesystem::remove(path_); }
+
+  std::string string() const { return path_.string(); }
+};
+
+// The main function of a program consisting of lines
+ast::function program(std::vector<ast::expr> const& lines)
+{
+  return ast::function({{ast::identifier("argc"), ast::identifier("argv")}, lines});
+}
+
+ast::pre_variable importModule(std::string const& path)
+{
+  auto import                       = ast::pre_variable("@import");
+  ast::attr(import).attributes["m"] = path;
+  return import;
+}
+
+// name.key(1)
+ast::expr callMember(std::string const& name, std::string const& key)
+{
+  return ast::binary_op<ast::call>(
+      {ast::set_to_call(ast::binary_op<ast::dot>({ast::variable(name), ast::struct_key(key)}),
+                        true),
+       ast::arglist({ast::integer(1)})});
+}
+
+std::unique_ptr<assembly::module> translateProgram(ast::expr const& tree)
+{
+  scopion::error err;
+  scopion::assembly::translator tr{};
+  tr.createMain();
+  auto* res = tr.translateAST(tree, err);
+  if (!res || !tr.createMainRet(res, err)) {
+    std::cerr << err << std::endl;
+    throw err;
+  }
+  return tr.takeModule();
+}
+
+long countDefinedFunctions(assembly::module const& mod)
+{
+  auto& funcs = mod.getLLVMModule()->getFunctionList();
+  return std::count_if(funcs.begin(), funcs.end(),
+                       [](auto const& f) { return !f.isDeclaration(); });
+}
+
 TEST_F(assemblyTest, variable)
 {
   auto tree = ast::function(
@@ -75,4 +149,331 @@ entry:
   EXPECT_EQ(str, scopion::assembly::getNameString(lres));
 }
 
+TEST_F(assemblyTest, copiedScope)
+{
+  assembly::region rg;
+  auto scope            = rg.makeValue();
+  auto x                = rg.makeValue();
+  scope->symbols()["x"] = x;
+
+  // the copy shares the symbols until one side writes to them
+  auto copy = scope->copy();
+  EXPECT_EQ(&*scope->symbols().find("x"), &*copy->symbols().find("x"));
+
+  auto y               = rg.makeValue();
+  copy->symbols()["y"] = y;
+  EXPECT_NE(&*scope->symbols().find("x"), &*copy->symbols().find("x"));
+  EXPECT_EQ(0u, scope->symbols().count("y"));
+  EXPECT_EQ(y, copy->symbols().at("y"));
+
+  scope->symbols()["x"] = y;
+  EXPECT_EQ(y, scope->symbols().at("x"));
+  EXPECT_EQ(x, copy->symbols().at("x"));
+}
+
+TEST_F(assemblyTest, specializationCache)
+{
+  auto tree = program(
+      {ast::binary_op<ast::assign>(
+           {ast::set_lval(ast::variable("f"), true),
+            ast::function(
+                {{ast::identifier("a")}, {ast::single_op<ast::ret>({ast::variable("a")})}})}),
+       ast::binary_op<ast::call>(
+           {ast::set_to_call(ast::variable("f"), true), ast::arglist({ast::integer(1)})}),
+       ast::binary_op<ast::call>(
+           {ast::set_to_call(ast::variable("f"), true), ast::arglist({ast::integer(2)})})});
+
+  auto mod = translateProgram(tree);
+  EXPECT_EQ(3, countDefinedFunctions(*mod));  // main, the top-level function and one of f
+}
+
+TEST_F(assemblyTest, recursiveFunction)
+{
+  scopion::error err;
+  auto const tree = parser::parse(
+      "(argc, argv){ f = (a){ a > 10 ? { |> a; } : { @self(a + 1); }; |> 1; }; f(1); }", err);
+  ASSERT_TRUE(tree);
+
+  auto mod = translateProgram(*tree);
+  EXPECT_EQ(3, countDefinedFunctions(*mod));  // the body of f is lowered once
+
+  auto& funcs = mod->getLLVMModule()->getFunctionList();
+  auto f      = std::find_if(funcs.begin(), funcs.end(),
+                        [](auto const& fn) { return fn.arg_size() == 1 && !fn.isDeclaration(); });
+  ASSERT_NE(funcs.end(), f);
+  EXPECT_TRUE(f->getReturnType()->isIntegerTy(32));
+
+  std::vector<llvm::CallInst const*> calls;
+  for (auto const& bb : *f) {
+    for (auto const& inst : bb) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst))
+        calls.push_back(call);
+    }
+  }
+  ASSERT_EQ(1u, calls.size());
+  EXPECT_EQ(&*f, calls[0]->getCalledFunction());  // a direct call with the retyped signature
+}
+
+TEST_F(assemblyTest, structTypeCache)
+{
+  auto tree = program({ast::structure({{ast::struct_key("a"), ast::integer(1)}}),
+                       ast::structure({{ast::struct_key("b"), ast::integer(2)}}),
+                       ast::structure({{ast::struct_key("c"), ast::boolean(true)}})});
+
+  auto mod = translateProgram(tree);
+  EXPECT_EQ(2u, mod->getLLVMModule()->getIdentifiedStructTypes().size());  // {i32} and {i1}
+}
+
+TEST_F(assemblyTest, splitEmitDeterminism)
+{
+  scopion::error err;
+  auto const tree = parser::parse(
+      "(argc, argv){ f = (a){ |> a + 1; }; g = (a){ |> a * 2; }; h = (a){ |> a - 3; }; "
+      "|> f(1) + g(2) + h(3); }",
+      err);
+  ASSERT_TRUE(tree);
+
+  // the same path for both runs, so that nothing but the number of threads differs
+  auto const path =
+      (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  auto const emit = [&](unsigned jobs) {
+    auto mod = translateProgram(*tree);
+    std::vector<std::string> objects;
+    scopion::error e;
+    if (!mod->emitSplit(path, llvm::sys::getDefaultTargetTriple(), 0, 0, jobs, objects, e)) {
+      std::cerr << e << std::endl;
+      throw e;
+    }
+    std::vector<std::string> contents;
+    for (auto const& o : objects) {
+      std::ifstream ifs(o, std::ios::binary);
+      contents.emplace_back(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      boost::filesystem::remove(o);
+    }
+    return contents;
+  };
+
+  auto const serial = emit(1);
+  EXPECT_LT(1u, serial.size());
+  EXPECT_EQ(serial, emit(4));
+}
+
+TEST_F(assemblyTest, importOnce)
+{
+  tempFile file(".scc", "[f: (a){ |> a; }]");
+  auto tree = program(
+      {ast::binary_op<ast::assign>(
+           {ast::set_lval(ast::variable("a"), true), importModule(file.string())}),
+       ast::binary_op<ast::assign>(
+           {ast::set_lval(ast::variable("b"), true), importModule(file.string())}),
+       callMember("a", "f"), callMember("b", "f")});
+
+  auto mod = translateProgram(tree);
+  EXPECT_EQ(3, countDefinedFunctions(*mod));  // both imports share f, which is specialized once
+}
+
+TEST_F(assemblyTest, importOnDemand)
+{
+  tempFile file(".scc", "[used: (a#type:i32){ |> a; }, unused: (a#type:i32){ |> a; }]");
+  auto importing = [&](std::size_t calls) {
+    std::vector<ast::expr> lines{ast::binary_op<ast::assign>(
+        {ast::set_lval(ast::variable("m"), true), importModule(file.string())})};
+    lines.insert(lines.end(), calls, callMember("m", "used"));
+    return translateProgram(program(lines));
+  };
+  // the allocas in the entry block of the top-level function
+  auto countAllocas = [](assembly::module const& mod) {
+    auto& funcs = mod.getLLVMModule()->getFunctionList();
+    auto top    = std::find_if(funcs.begin(), funcs.end(), [](auto const& f) {
+      return !f.isDeclaration() && f.arg_size() == 2 && f.getName() != "main";
+    });
+    EXPECT_NE(funcs.end(), top);
+    auto& entry = top->getEntryBlock();
+    return std::count_if(entry.begin(), entry.end(),
+                         [](auto const& inst) { return llvm::isa<llvm::AllocaInst>(inst); });
+  };
+
+  auto once  = importing(1);
+  auto twice = importing(2);
+  EXPECT_EQ(3, countDefinedFunctions(*once));  // main, the top-level function and "used"
+  EXPECT_EQ(3, countDefinedFunctions(*twice));
+  EXPECT_EQ(countAllocas(*once), countAllocas(*twice));  // referring to a member emits no memory
+}
+
+TEST_F(assemblyTest, importIRMember)
+{
+  tempFile ir(".ll", "declare i32 @abs(i32)\ndeclare i64 @labs(i64)\n");
+  auto import                        = ast::pre_variable("@import");
+  ast::attr(import).attributes["ir"] = ir.string();
+  auto tree                          = program(
+      {ast::binary_op<ast::assign>({ast::set_lval(ast::variable("m"), true), import}),
+       callMember("m", "abs")});
+
+  auto mod  = translateProgram(tree);
+  auto* abs = mod->getLLVMModule()->getFunction("abs");
+  ASSERT_NE(nullptr, abs);
+  EXPECT_EQ(nullptr, mod->getLLVMModule()->getFunction("labs"));  // declared only when used
+
+  int n_calls = 0;
+  for (auto const& f : *mod->getLLVMModule()) {
+    for (auto const& bb : f) {
+      for (auto const& inst : bb) {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst))
+          n_calls += call->getCalledFunction() == abs;
+        // function pointers are kept only in @self; the namespace and its members are not
+        if (auto alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst)) {
+          auto const ty = alloca->getAllocatedType();
+          if (ty->isPointerTy() && ty->getPointerElementType()->isFunctionTy())
+            EXPECT_EQ("__self", alloca->getName().str());
+        }
+        if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+          if (llvm::isa<llvm::Function>(store->getValueOperand()))
+            EXPECT_EQ("__self", store->getPointerOperand()->getName().str());
+        }
+      }
+    }
+  }
+  EXPECT_EQ(1, n_calls);
+}
+
+TEST_F(assemblyTest, importInterface)
+{
+  scopion::error err;
+  auto const module = parser::parse("[used: (a#type:i32){ |> a; }, lazy: (a){ |> a; }]", err);
+  ASSERT_TRUE(module);
+
+  std::string interface;
+  scopion::assembly::translator exporter{};
+  if (!exporter.exportModule(*module, interface, err)) {
+    std::cerr << err << std::endl;
+    throw err;
+  }
+  EXPECT_EQ(1, countDefinedFunctions(*exporter.takeModule()));  // only "used"
+
+  tempFile file(".sci", interface);
+  auto tree = program({ast::binary_op<ast::assign>(
+                           {ast::set_lval(ast::variable("m"), true), importModule(file.string())}),
+                       callMember("m", "used"), callMember("m", "lazy")});
+
+  auto mod = translateProgram(tree);
+  EXPECT_EQ(3, countDefinedFunctions(*mod));  // main, the top-level function and "lazy"
+}
+
+TEST_F(assemblyTest, objectCache)
+{
+  // entries are kept under $HOME
+  auto const home = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string const prev_home = std::getenv("HOME");
+  setenv("HOME", home.c_str(), 1);
+
+  tempFile dependency(".ll", "declare i32 @abs(i32)\n");
+  auto import                          = ast::pre_variable("@import");
+  ast::attr(import).attributes["ir"]   = dependency.string();
+  ast::attr(import).attributes["link"] = "m";
+  auto const mod                       = translateProgram(program({import}));
+
+  auto const key = assembly::object_cache::hash({"objectCache"});
+  assembly::object_cache cold(key);
+  EXPECT_FALSE(cold.load());
+  cold.record(*mod);
+  cold.notifyObjectCompiled(nullptr, llvm::MemoryBufferRef("object", "objectCache"));
+
+  assembly::object_cache warm(key);
+  EXPECT_TRUE(warm.load());
+  EXPECT_EQ("object", warm.takeObject()->getBuffer());
+  EXPECT_EQ(std::vector<std::string>{"m"}, warm.getLinkLibraries());
+
+  std::ofstream(dependency.string()) << "declare i64 @labs(i64)\n";
+  assembly::object_cache changed(key);
+  EXPECT_FALSE(changed.load());
+
+  setenv("HOME", prev_home.c_str(), 1);
+  boost::filesystem::remove_all(home);
+}
+
+TEST_F(assemblyTest, replSession)
+{
+  assembly::session repl;
+  std::string result;
+  scopion::error err;
+
+  ASSERT_TRUE(repl.eval("x = 41", result, err)) << err;
+  ASSERT_TRUE(repl.eval("x + 1", result, err)) << err;
+  EXPECT_EQ("42", result);
+
+  // y is declared before the line fails, and is gone afterwards
+  EXPECT_FALSE(repl.eval("(y = 1) + undefined", result, err));
+  EXPECT_FALSE(repl.eval("y", result, err));
+  ASSERT_TRUE(repl.eval("x", result, err)) << err;
+  EXPECT_EQ("41", result);
+
+  // the specializations of f are dropped with the module each line is translated into
+  ASSERT_TRUE(repl.eval("f = (a){ |> a * 2; }", result, err)) << err;
+  ASSERT_TRUE(repl.eval("f(2)", result, err)) << err;
+  EXPECT_EQ("4", result);
+  ASSERT_TRUE(repl.eval("f(x)", result, err)) << err;
+  EXPECT_EQ("82", result);
+}
+
+TEST_F(assemblyTest, linkInterface)
+{
+  scopion::error err;
+  auto const triple = llvm::sys::getDefaultTargetTriple();
+  auto const emit   = [&](assembly::module& mod, std::string const& path) {
+    mod.hideUnnamedFunctions();
+    if (!mod.emit(path, triple, false, err)) {
+      std::cerr << err << std::endl;
+      throw err;
+    }
+  };
+  // the global symbols an object defines, and those it refers to
+  auto const symbols = [](std::string const& path) {
+    auto obj = llvm::object::ObjectFile::createObjectFile(path);
+    EXPECT_TRUE(static_cast<bool>(obj));
+    std::set<std::string> defined, undefined;
+    for (auto const& sym : obj->getBinary()->symbols()) {
+      auto const flags = sym.getFlags();
+      if (!(flags & llvm::object::BasicSymbolRef::SF_Global))
+        continue;
+      auto name = sym.getName();
+      if (!name) {
+        llvm::consumeError(name.takeError());
+        continue;
+      }
+      auto& set = flags & llvm::object::BasicSymbolRef::SF_Undefined ? undefined : defined;
+      set.insert(name->str());
+    }
+    return std::make_pair(defined, undefined);
+  };
+
+  // a lazy function specialized inside the exported one is compiled into the module's object
+  auto const module = parser::parse("[f: (a#type:i32){ g = (b){ |> b; }; |> g(a); }]", err);
+  ASSERT_TRUE(module);
+  std::string interface;
+  scopion::assembly::translator exporter{};
+  if (!exporter.exportModule(*module, interface, err)) {
+    std::cerr << err << std::endl;
+    throw err;
+  }
+  tempFile module_object(".o", "");
+  emit(*exporter.takeModule(), module_object.string());
+
+  tempFile file(".sci", interface);
+  tempFile program_object(".o", "");
+  auto importer = translateProgram(
+      program({ast::binary_op<ast::assign>(
+                   {ast::set_lval(ast::variable("m"), true), importModule(file.string())}),
+               callMember("m", "f")}));
+  emit(*importer, program_object.string());
+
+  auto const lib  = symbols(module_object.string());
+  auto const prog = symbols(program_object.string());
+  for (auto const& s : lib.first)
+    EXPECT_EQ(0u, prog.first.count(s)) << s << " is defined by both objects";
+  for (auto const& s : prog.second) {
+    if (boost::starts_with(s, "scopion_"))
+      EXPECT_EQ(1u, lib.first.count(s)) << s << " is not defined by the module";
+  }
+}
+
 }  // namespace
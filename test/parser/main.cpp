@@ -23,6 +23,11 @@
 
 #include "scopion/scopion.hpp"
 
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 namespace
 {
 using namespace scopion;
@@ -254,6 +259,88 @@ TEST_F(parserTest, priority)
                                                                       1)})})})})})})})})})})})})})));
 }
 
+TEST_F(parserTest, location)
+{
+  auto tree = parseWithErrorHandling("a +\n  bc");
+  auto& op  = boost::get<ast::binary_op<ast::add>>(boost::get<ast::operators>(tree));
+  auto loc  = ast::apply<locationInfo>(
+      [](auto const& x) -> locationInfo { return ast::attr(x).where; }, ast::val(op)[1]);
+  EXPECT_EQ(2u, loc.getLineNumber());
+  EXPECT_EQ("  bc", loc.getLineContent());
+  EXPECT_EQ("<not a file>", loc.getPathString());
+}
+
+TEST_F(parserTest, sourceRelease)
+{
+  std::weak_ptr<sourceFile const> file;
+  {
+    auto tree = parseWithErrorHandling("a + b");
+    file      = ast::attr(boost::get<ast::binary_op<ast::add>>(boost::get<ast::operators>(tree)))
+               .where.getFile();
+    EXPECT_FALSE(file.expired());
+  }
+  EXPECT_TRUE(file.expired());  // the code is freed with the last location in it
+}
+
+TEST_F(parserTest, concurrentLocations)
+{
+  auto const rhsLocation = [](std::string const& code) {
+    auto tree = parseWithErrorHandling(code);
+    auto& op  = boost::get<ast::binary_op<ast::add>>(boost::get<ast::operators>(tree));
+    return ast::apply<locationInfo>(
+        [](auto const& x) -> locationInfo { return ast::attr(x).where; }, ast::val(op)[1]);
+  };
+
+  // every thread parses code of its own, in which the operand is shifted by a different amount
+  std::vector<std::string> codes;
+  std::vector<uint32_t> expected;
+  for (size_t t = 0; t < 8; t++) {
+    codes.push_back(std::string(t, '\n') + "a +\n" + std::string(t, ' ') + "bc");
+    expected.push_back(rhsLocation(codes.back()).getOffset());
+  }
+
+  std::vector<int> failures(codes.size());
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < codes.size(); t++) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 200; i++) {
+        auto loc = rhsLocation(codes[t]);
+        if (loc.getOffset() != expected[t] || loc.getLineNumber() != t + 2 ||
+            loc.getLineContent() != std::string(t, ' ') + "bc")
+          failures[t]++;
+      }
+    });
+  }
+  for (auto& th : threads)
+    th.join();
+
+  for (auto f : failures)
+    EXPECT_EQ(0, f);
+}
+
+TEST_F(parserTest, deepNesting)
+{
+  std::string code = "1";
+  for (int i = 0; i < 200; i++)
+    code = "(" + code + ")";
+  EXPECT_EQ(parseWithErrorHandling(code), ast::expr(ast::integer(1)));
+
+  code = "a++";
+  for (int i = 0; i < 200; i++)
+    code = "(1 + " + code + ")";
+  EXPECT_NO_THROW(parseWithErrorHandling(code));
+}
+
+TEST_F(parserTest, copyIndependence)
+{
+  auto tree = parseWithErrorHandling("1 + 2");
+  auto copy = tree;
+  ast::val(boost::get<ast::binary_op<ast::add>>(boost::get<ast::operators>(copy)))[1] =
+      ast::integer(3);
+  EXPECT_EQ(tree, ast::expr(ast::binary_op<ast::add>({ast::integer(1), ast::integer(2)})));
+  EXPECT_EQ(copy, ast::expr(ast::binary_op<ast::add>({ast::integer(1), ast::integer(3)})));
+}
+
 TEST_F(parserTest, escapeSequence)
 {
   EXPECT_EQ(parseWithErrorHandling(R"("\n\t\b\f\r\v\a\\\s\"")"),
@@ -261,4 +348,20 @@ TEST_F(parserTest, escapeSequence)
   EXPECT_EQ(parseWithErrorHandling(R"('\n\t\b\f\r\v\a\s\'')"),
             ast::expr(ast::string("\\n\\t\\b\\f\\r\\v\\a\\s'")));
 }
+
+TEST_F(parserTest, sourceRoundTrip)
+{
+  std::vector<std::string> const codes = {
+      R"((argc, argv){ a#mut = 1 + 2 * 3 ** 4 - 5 / 6 % 7; a++; --a; |> !a && ~a || a; })",
+      R"([value: 0, +: (l, r){ |> l.value + r.value; }, func: (self) { self.=inc(); }])",
+      R"({ a = [1, 2.5, 1e-7, true, "q\"\n\t\\x"]; a[1] = a[0] << 2 >> 1 & 3 | 4 ^ 5; })",
+      R"({ io = @import#c:stdio.h; io.printf("%d", x > 1 ? y : z); ((a) a <= 3)(x); })",
+      R"(f = (arg#type:i32, arg2#type:i32){ |> arg + arg2 == arg != arg2; }#rettype:i32)",
+      R"([k: (a)a, l: (){}#lazy, m: o.:p(1, 2)(3)])",
+  };
+  for (auto const& code : codes) {
+    auto const tree = parseWithErrorHandling(code);
+    EXPECT_EQ(tree, parseWithErrorHandling(ast::toSource(tree))) << ast::toSource(tree);
+  }
+}
 }